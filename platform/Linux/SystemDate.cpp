@@ -0,0 +1,111 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <libical/ical.h>
+
+#include "SystemDate.h"
+#include "ZoneCache.he"
+
+#include <climits>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <unistd.h>
+
+// Zone names are the path below the zoneinfo directory, e.g. /usr/share/zoneinfo/Europe/London
+static bool getZoneFromPath(const std::string& path, std::string& name) {
+    const std::string zoneinfo = "zoneinfo/";
+    std::string::size_type pos = path.rfind(zoneinfo);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    name = path.substr(pos + zoneinfo.size());
+    
+    // The posix and right directories hold the same zones
+    if (name.compare(0, 6, "posix/") == 0) {
+        name.erase(0, 6);
+    } else if (name.compare(0, 6, "right/") == 0) {
+        name.erase(0, 6);
+    }
+    return !name.empty();
+}
+
+// Zone named by a zoneinfo file, following it if it's a link (e.g. /etc/localtime)
+static bool getZoneFromFile(const std::string& path, std::string& name) {
+    char link[PATH_MAX];
+    ssize_t length = readlink(path.c_str(), link, sizeof(link) - 1);
+    if (length > 0) {
+        link[length] = 0;
+        return getZoneFromPath(link, name);
+    }
+    return getZoneFromPath(path, name);
+}
+
+// Other names of UTC, which the built-in zones don't include
+static bool isUTCAlias(const std::string& name) {
+    const char* aliases[] = { "Etc/UTC", "Etc/UCT", "Etc/GMT", "Etc/GMT0", "Etc/GMT+0", "Etc/GMT-0", "Etc/Greenwich", 
+                              "Etc/Universal", "Etc/Zulu", "UCT", "GMT", "GMT0", "GMT+0", "GMT-0", "Greenwich", 
+                              "Universal", "Zulu" };
+    for (std::size_t x = 0; x < sizeof(aliases) / sizeof(aliases[0]); ++x) {
+        if (name == aliases[x]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SystemTimeZone::query(std::string& name, bool& isDaylight) {
+    name.clear();
+    
+    // TZ is a zone name or path, optionally after a colon, or a POSIX rule (e.g. EST5EDT)
+    const char* tz = getenv("TZ");
+    std::string tzString((tz && *tz == ':') ? tz + 1 : (tz ? tz : ""));
+    if (!tzString.empty() && tzString[0] != '/') {
+        name = tzString;
+    } else {
+        getZoneFromFile(tzString.empty() ? std::string("/etc/localtime") : tzString, name);
+        
+        // Debian based systems also name the zone in /etc/timezone, for when /etc/localtime is a copy
+        if (name.empty() && (tzString.empty() || tzString == "/etc/localtime")) {
+            std::ifstream file("/etc/timezone");
+            std::getline(file, name);
+            std::string::size_type end = name.find_last_not_of(" \t\r\n");
+            name.erase(end == std::string::npos ? 0 : end + 1);
+        }
+    }
+    
+    // Names that aren't built-in zones, such as POSIX rules, default to UTC
+    if (isUTCAlias(name) || name.empty()) {
+        name = "UTC";
+    } else if (name != "UTC") {
+        boost::recursive_mutex::scoped_lock libical(iCalTools::ZoneCache::libicalLock());
+        if (!icaltimezone_get_builtin_timezone(name.c_str())) {
+            name = "UTC";
+        }
+    }
+    
+    // Daylight status from the C library, after it rereads the zone
+    tzset();
+    time_t now = time(0);
+    struct tm local;
+    isDaylight = (localtime_r(&now, &local) != 0 && local.tm_isdst > 0);
+}
\ No newline at end of file
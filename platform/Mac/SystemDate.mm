@@ -24,18 +24,17 @@
 
 #import <Foundation/Foundation.h>
 
-SystemTimeZone::SystemTimeZone() {
+void SystemTimeZone::query(std::string& name, bool& isDaylight) {
     // Setup auto-release pool
     NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
     
-    // Get system time zone
+    // Get system time zone.  Foundation keeps its own copy, so it's dropped first to see a new setting.
+    [NSTimeZone resetSystemTimeZone];
     NSTimeZone* currentZone = [NSTimeZone localTimeZone];
     
-    _name = [currentZone.name UTF8String];
-    _isDaylight = [currentZone isDaylightSavingTime];
+    name = [currentZone.name UTF8String];
+    isDaylight = [currentZone isDaylightSavingTime];
     
     // Release all 
     [pool release];
-}
-
-SystemTimeZone::~SystemTimeZone() {}
\ No newline at end of file
+}
\ No newline at end of file
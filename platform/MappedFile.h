@@ -0,0 +1,58 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <string>
+#include <cstddef>
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+// Read-only view of a regular file mapped into memory.  The mapping is private (copy-on-write) so 
+// the mapped bytes can be modified in place without the changes ever reaching the file.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    
+    // Map the file.  Returns false for anything that isn't a non-empty regular file or can't be mapped.
+    bool open(const std::string& path);
+    void close();
+    
+    bool isOpen() { return _data != 0; }
+    char* data() { return _data; }
+    std::size_t size() { return _size; }
+    
+    // False if the file has been truncated since it was mapped.  Touching mapped pages past the new end 
+    // of the file faults, so check this before reading a part of the mapping for the first time.
+    bool isIntact();
+    
+private:
+    // Mappings can't be copied
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+    
+    char* _data;
+    std::size_t _size;
+    int _fd; // Kept open for isIntact() (Unused on Windows)
+};
+
+#endif // MAPPED_FILE_H
\ No newline at end of file
@@ -0,0 +1,90 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "MappedFile.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() : _data(0), _size(0), _fd(-1) {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    
+    // Only map regular files (Pipes, devices, etc. are read through the stream instead)
+    struct stat fileInfo;
+    if (fstat(fd, &fileInfo) != 0 || !S_ISREG(fileInfo.st_mode) || fileInfo.st_size <= 0 
+        || static_cast<off_t>(static_cast<std::size_t>(fileInfo.st_size)) != fileInfo.st_size) 
+    {
+        ::close(fd);
+        return false;
+    }
+    
+    // The mapping holds its own reference to the file, but the descriptor is kept for isIntact()
+    std::size_t size = static_cast<std::size_t>(fileInfo.st_size);
+    void* addr = mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+    
+    // Content is read front to back
+    madvise(addr, size, MADV_SEQUENTIAL);
+    
+    _data = static_cast<char*>(addr);
+    _size = size;
+    _fd = fd;
+    
+    return true;
+}
+
+bool MappedFile::isIntact() {
+    if (!_data) {
+        return false;
+    }
+    
+    // Another process can truncate the file under a private mapping, which turns reads of the lost pages into SIGBUS
+    struct stat fileInfo;
+    return (fstat(_fd, &fileInfo) == 0 && fileInfo.st_size >= static_cast<off_t>(_size));
+}
+
+void MappedFile::close() {
+    if (_data) {
+        munmap(_data, _size);
+        ::close(_fd);
+    }
+    _data = 0;
+    _fd = -1;
+    _size = 0;
+}
\ No newline at end of file
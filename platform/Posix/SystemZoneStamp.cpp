@@ -0,0 +1,49 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "SystemDate.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cstdlib>
+#include <sstream>
+
+// The zone is set by TZ, or else by /etc/localtime, which is usually a link into the zoneinfo directory.  The link 
+// and the file it points to are both checked, since setting a new zone may replace either.
+std::string SystemTimeZone::changeStamp() {
+    std::ostringstream stamp;
+    
+    const char* tz = getenv("TZ");
+    if (tz) {
+        stamp << "TZ=" << tz;
+    }
+    
+    struct stat fileInfo;
+    if (lstat("/etc/localtime", &fileInfo) == 0) {
+        stamp << "|" << fileInfo.st_ino << ":" << fileInfo.st_mtime;
+    }
+    if (stat("/etc/localtime", &fileInfo) == 0) {
+        stamp << "|" << fileInfo.st_ino << ":" << fileInfo.st_mtime;
+    }
+    
+    return stamp.str();
+}
\ No newline at end of file
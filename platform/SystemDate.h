@@ -25,6 +25,9 @@
 #ifndef SYSTEM_DATE_H
 #define SYSTEM_DATE_H
 
+// The system time zone.  Asking the OS for it is slow, so it's cached for the process (See SystemTimeZone.cpp) and 
+// only asked for again when a cheap check shows the zone setting may have changed, or when daylight time may have 
+// started or ended.
 class SystemTimeZone {
 public:
     SystemTimeZone();
@@ -34,6 +37,13 @@ public:
     bool isDaylight() { return _isDaylight; }
     
 private:
+    // Asks the OS for the current zone (Implemented for each platform)
+    static void query(std::string& name, bool& isDaylight);
+    
+    // Changes when the zone setting may have changed: the TZ environment variable, and on POSIX systems the 
+    // /etc/localtime link or file (Implemented for each platform)
+    static std::string changeStamp();
+    
     std::string _name;
     bool _isDaylight;
 };
@@ -24,6 +24,7 @@
 #include "OmnisTools.he"
 
 #include <windows.h>
+#include <cstdlib>
 #include <map>
 
 // Build mapping from Windows Timezone to Olson Timezone (Used in libical)
@@ -209,7 +210,7 @@ void buildOlsonMap() {
 	olsonMap[L"Yakutsk Standard Time"] = "Asia/Yakutsk";
 }
 
-SystemTimeZone::SystemTimeZone() {    
+void SystemTimeZone::query(std::string& name, bool& isDaylight) {    
     buildOlsonMap();
 	
 	// Use Windows API to determine daylight savings time status
@@ -226,16 +227,16 @@ SystemTimeZone::SystemTimeZone() {
 	// Get daylight savings status
 	switch (returnCode) {
 		case TIME_ZONE_ID_UNKNOWN:
-			_isDaylight = false;
+			isDaylight = false;
 			break;
 		case TIME_ZONE_ID_STANDARD:
-			_isDaylight = false;
+			isDaylight = false;
 			break;
 		case TIME_ZONE_ID_DAYLIGHT:
-			_isDaylight = true;
+			isDaylight = true;
 			break;
 		default:
-			_isDaylight = false;
+			isDaylight = false;
 			break;
 	}
 
@@ -243,10 +244,14 @@ SystemTimeZone::SystemTimeZone() {
 	std::map<std::wstring,std::string>::iterator it;
 	it = olsonMap.find(windowsName);
 	if (it == olsonMap.end()) {
-		_name = "UTC";  // Default to UTC
+		name = "UTC";  // Default to UTC
 	} else {
-		_name = (*it).second;
+		name = (*it).second;
 	}
 }
 
-SystemTimeZone::~SystemTimeZone() { }
\ No newline at end of file
+// Windows keeps the zone setting in the registry, which is read again each minute, so only TZ is checked
+std::string SystemTimeZone::changeStamp() {
+	const char* tz = getenv("TZ");
+	return (tz ? std::string("TZ=") + tz : std::string());
+}
\ No newline at end of file
@@ -0,0 +1,158 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "BatchExpansion.he"
+#include "RecurrenceIterator.he"
+#include "ZoneTransitions.he"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <map>
+
+using namespace iCalTools;
+
+// Fewer rules than this per thread isn't worth the cost of starting the thread
+const static std::size_t kMinRulesPerThread = 256;
+
+// Orders local times without converting them to UTC
+static long long wallKey(const icaltimetype& tt) {
+    return ((((static_cast<long long>(tt.year) * 12 + tt.month) * 31 + tt.day) * 24 + tt.hour) * 60 + tt.minute) * 60 + tt.second;
+}
+
+static bool occursBefore(const BatchOccurrence& a, const BatchOccurrence& b) {
+    return (a.start < b.start || (a.start == b.start && a.row < b.row));
+}
+
+// Expands a contiguous run of rules into a separate results vector.  Each chunk converts times with its own 
+// ZoneTransitions, which only read the shared tables of the built-in zones and otherwise call libical under its lock.
+class ExpandChunk {
+public:
+    ExpandChunk(const std::vector<BatchRule>* r, std::vector<BatchOccurrence>* o, std::size_t f, std::size_t l, time_t fr, time_t t) 
+        : rules(r), occurrences(o), first(f), last(l), from(fr), to(t) 
+    { }
+    
+    void operator()() {
+        std::map< icaltimezone*, boost::shared_ptr<ZoneTransitions> > zones;
+        
+        for (std::size_t row = first; row < last; row++) {
+            const BatchRule& batchRule = (*rules)[row];
+            boost::shared_ptr<ZoneTransitions>& zone = zones[batchRule.zone];
+            if (!zone) {
+                zone = boost::shared_ptr<ZoneTransitions>(new ZoneTransitions(batchRule.zone));
+            }
+            
+            // Occurrences are local times, so stop by local time before converting anything far past the window
+            icaltimetype seekTo = zone->fromTimet(from - 86400, batchRule.dtstart.is_date);
+            long long limit = wallKey(zone->fromTimet(to + 86400, 0));
+            
+            RecurrenceIterator it(batchRule.rule, batchRule.dtstart, seekTo);
+            if (!it.isValid())
+                continue;
+            
+            for (icaltimetype next = it.next(); !icaltime_is_null_time(next) && wallKey(next) <= limit; next = it.next()) {
+                BatchOccurrence occurrence;
+                occurrence.row = row;
+                occurrence.start = zone->asTimet(next);
+                if (occurrence.start >= to)
+                    break;
+                if (occurrence.start >= from)
+                    occurrences->push_back(occurrence);
+            }
+        }
+        
+        // Each rule is in order, so this mostly merges them
+        std::sort(occurrences->begin(), occurrences->end(), occursBefore);
+    }
+    
+private:
+    const std::vector<BatchRule>* rules;
+    std::vector<BatchOccurrence>* occurrences;
+    std::size_t first;
+    std::size_t last;
+    time_t from;
+    time_t to;
+};
+
+void iCalTools::expandRulesParallel(const std::vector<BatchRule>& rules, time_t from, time_t to, std::vector<BatchOccurrence>& occurrences, 
+                                    unsigned int threadCount) 
+{
+    occurrences.clear();
+    if (rules.empty() || from >= to) {
+        return;
+    }
+    
+    // Work out the number of chunks
+    std::size_t ruleCount = rules.size();
+    if (threadCount == 0) {
+        threadCount = boost::thread::hardware_concurrency();
+    }
+    std::size_t chunkCount = ruleCount / kMinRulesPerThread;
+    if (chunkCount > threadCount) {
+        chunkCount = threadCount;
+    }
+    if (chunkCount < 1) {
+        chunkCount = 1;
+    }
+    
+    if (chunkCount == 1) {
+        ExpandChunk(&rules, &occurrences, 0, ruleCount, from, to)();
+        return;
+    }
+    
+    // Split the rules into chunks of equal size and expand them
+    std::vector< std::vector<BatchOccurrence> > results(chunkCount);
+    std::size_t rulesPerChunk = ruleCount / chunkCount + 1;
+    boost::thread_group workers;
+    for (std::size_t chunk = 0; chunk < chunkCount; chunk++) {
+        std::size_t first = chunk * rulesPerChunk;
+        std::size_t last = first + rulesPerChunk;
+        if (last > ruleCount) {
+            last = ruleCount;
+        }
+        if (first >= last) {
+            break;
+        }
+        
+        ExpandChunk expandChunk(&rules, &results[chunk], first, last, from, to);
+        try {
+            workers.create_thread(expandChunk);
+        } catch (boost::thread_resource_error&) {
+            // Out of threads, so expand this chunk here
+            expandChunk();
+        }
+    }
+    workers.join_all();
+    
+    // Merge the sorted chunks
+    std::size_t total = 0;
+    for (std::size_t chunk = 0; chunk < chunkCount; chunk++) {
+        total += results[chunk].size();
+    }
+    occurrences.reserve(total);
+    for (std::size_t chunk = 0; chunk < chunkCount; chunk++) {
+        std::size_t middle = occurrences.size();
+        occurrences.insert(occurrences.end(), results[chunk].begin(), results[chunk].end());
+        std::inplace_merge(occurrences.begin(), occurrences.begin() + middle, occurrences.end(), occursBefore);
+    }
+}
\ No newline at end of file
@@ -27,13 +27,29 @@
 #include "iCalTools.he"
 
 #include "Date.he"
+#include "MappedFile.h"
+#include "ParallelParser.he"
+#include "LazyComponent.he"
+#include "ICSWriter.he"
+#include "Snapshot.he"
+#include "JCal.he"
+#include "Expansion.he"
+#include "ZoneCache.he"
+#include "ZoneTransitions.he"
+#include "SystemDate.h"
 
 // fopen and FILE
 #include <stdio.h>
 
+// free
+#include <stdlib.h>
+
 // Format of error messages
 #include <boost/format.hpp>
 
+// Per-thread $loadText buffer
+#include <boost/thread/tss.hpp>
+
 using namespace OmnisTools;
 using namespace iCalTools;
 using namespace LibiCalConstants;
@@ -56,6 +72,7 @@ void KeepComponent (icalcomponent *comp) {
 
 void FreeComponent (icalcomponent *comp) {
     if (comp) {
+        ZoneCache::instance().forgetZones(comp);
         icalcomponent_free(comp);
     }
 }
@@ -68,6 +85,7 @@ void NVObjComponent::copy( NVObjComponent* pObj ) {
     NVObjBase::copy(pObj);
     
     comp = pObj->comp;
+    lazyIndex = pObj->lazyIndex;
 }
 
 /**************************************************************************************************
@@ -92,7 +110,16 @@ const static qshort cCompMethodError              = 2000,
                     cCompMethodFirstPropertyValue = 2014,
                     cCompMethodNextPropertyValue  = 2015,
                     cCompMethodPropertyToList     = 2016,
-                    cCompMethodListToProperty     = 2017;
+                    cCompMethodListToProperty     = 2017,
+                    cCompMethodFindComponent      = 2018,
+                    cCompMethodSave               = 2019,
+                    cCompMethodWriteTo            = 2020,
+                    cCompMethodBeginOutput        = 2021,
+                    cCompMethodNextOutputChunk    = 2022,
+                    cCompMethodSaveSnapshot       = 2023,
+                    cCompMethodLoadSnapshot       = 2024,
+                    cCompMethodLoadJCal           = 2025,
+                    cCompMethodExpandInstances    = 2026;
 
 
 // Table of parameter resources and types.
@@ -115,6 +142,7 @@ ECOparam cComponentMethodsParamsTable[] =
 	2804, fftConstant,  0, 0,
     // $load
 	2805, fftCharacter, 0, 0,
+	2827, fftConstant,  EXTD_FLAG_PARAMOPT, 0,
     // $loadText
 	2806, fftCharacter, 0, 0,
     // $firstComponent
@@ -148,7 +176,26 @@ ECOparam cComponentMethodsParamsTable[] =
     2823, fftCharacter, 0, 0,
     2824, fftConstant,  0, 0,
     2825, fftCharacter, 0, 0,
-    2826, fftConstant,  0, 0
+    2826, fftConstant,  0, 0,
+    // $findComponent
+    2828, fftCharacter, 0, 0,
+    // $save
+    2829, fftCharacter, 0, 0,
+    // $writeTo
+    2830, fftBinary,    0, 0,
+    // $nextOutputChunk
+    2831, fftInteger,   EXTD_FLAG_PARAMOPT, 0,
+    // $saveSnapshot
+    2832, fftCharacter, 0, 0,
+    2833, fftCharacter, EXTD_FLAG_PARAMOPT, 0,
+    // $loadSnapshot
+    2834, fftCharacter, 0, 0,
+    2835, fftCharacter, EXTD_FLAG_PARAMOPT, 0,
+    // $loadJCal
+    2836, fftCharacter, 0, 0,
+    // $expandInstances
+    2837, fftDate,      0, 0,
+    2838, fftDate,      0, 0
 };
 
 // Table of Methods available
@@ -164,22 +211,31 @@ ECOmethodEvent cComponentMethodsTable[] =
 {
 	cCompMethodError,              cCompMethodError,              fftNumber,  4, &cComponentMethodsParamsTable[0],  0, 0,
 	cCompMethodInitialize,         cCompMethodInitialize,         fftNone,    1, &cComponentMethodsParamsTable[4],  0, 0,
-    cCompMethodLoad,               cCompMethodLoad,               fftNone,    1, &cComponentMethodsParamsTable[5],  0, 0,
-    cCompMethodLoadText,           cCompMethodLoadText,           fftNone,    1, &cComponentMethodsParamsTable[6],  0, 0,
-    cCompMethodFirstComponent,     cCompMethodFirstComponent,     fftObject,  1, &cComponentMethodsParamsTable[7],  0, 0,
-    cCompMethodNextComponent,      cCompMethodNextComponent,      fftObject,  1, &cComponentMethodsParamsTable[8],  0, 0,
-    cCompMethodFirstProperty,      cCompMethodFirstProperty,      fftObject,  1, &cComponentMethodsParamsTable[9],  0, 0,
-    cCompMethodNextProperty,       cCompMethodNextProperty,       fftObject,  1, &cComponentMethodsParamsTable[10], 0, 0,
+    cCompMethodLoad,               cCompMethodLoad,               fftNone,    2, &cComponentMethodsParamsTable[5],  0, 0,
+    cCompMethodLoadText,           cCompMethodLoadText,           fftNone,    1, &cComponentMethodsParamsTable[7],  0, 0,
+    cCompMethodFirstComponent,     cCompMethodFirstComponent,     fftObject,  1, &cComponentMethodsParamsTable[8],  0, 0,
+    cCompMethodNextComponent,      cCompMethodNextComponent,      fftObject,  1, &cComponentMethodsParamsTable[9],  0, 0,
+    cCompMethodFirstProperty,      cCompMethodFirstProperty,      fftObject,  1, &cComponentMethodsParamsTable[10], 0, 0,
+    cCompMethodNextProperty,       cCompMethodNextProperty,       fftObject,  1, &cComponentMethodsParamsTable[11], 0, 0,
     cCompMethodCheckRestrictions,  cCompMethodCheckRestrictions,  fftInteger, 0,                                 0, 0, 0,
     cCompMethodStripErrors,        cCompMethodStripErrors,        fftNone,    0,                                 0, 0, 0,
-    cCompMethodAddComponent,       cCompMethodAddComponent,       fftNone,    1, &cComponentMethodsParamsTable[11], 0, 0,
-    cCompMethodRemoveComponent,    cCompMethodRemoveComponent,    fftNone,    1, &cComponentMethodsParamsTable[12], 0, 0,
-    cCompMethodAddProperty,        cCompMethodAddProperty,        fftNone,    1, &cComponentMethodsParamsTable[13], 0, 0,
-    cCompMethodRemoveProperty,     cCompMethodRemoveProperty,     fftNone,    1, &cComponentMethodsParamsTable[14], 0, 0,
-    cCompMethodFirstPropertyValue, cCompMethodFirstPropertyValue, fftObject,  1, &cComponentMethodsParamsTable[15], 0, 0,
-    cCompMethodNextPropertyValue,  cCompMethodNextPropertyValue,  fftObject,  1, &cComponentMethodsParamsTable[16], 0, 0,
-    cCompMethodPropertyToList,     cCompMethodPropertyToList,     fftNone,    5, &cComponentMethodsParamsTable[17], 0, 0,
-    cCompMethodListToProperty,     cCompMethodListToProperty,     fftNone,    5, &cComponentMethodsParamsTable[22], 0, 0
+    cCompMethodAddComponent,       cCompMethodAddComponent,       fftNone,    1, &cComponentMethodsParamsTable[12], 0, 0,
+    cCompMethodRemoveComponent,    cCompMethodRemoveComponent,    fftNone,    1, &cComponentMethodsParamsTable[13], 0, 0,
+    cCompMethodAddProperty,        cCompMethodAddProperty,        fftNone,    1, &cComponentMethodsParamsTable[14], 0, 0,
+    cCompMethodRemoveProperty,     cCompMethodRemoveProperty,     fftNone,    1, &cComponentMethodsParamsTable[15], 0, 0,
+    cCompMethodFirstPropertyValue, cCompMethodFirstPropertyValue, fftObject,  1, &cComponentMethodsParamsTable[16], 0, 0,
+    cCompMethodNextPropertyValue,  cCompMethodNextPropertyValue,  fftObject,  1, &cComponentMethodsParamsTable[17], 0, 0,
+    cCompMethodPropertyToList,     cCompMethodPropertyToList,     fftNone,    5, &cComponentMethodsParamsTable[18], 0, 0,
+    cCompMethodListToProperty,     cCompMethodListToProperty,     fftNone,    5, &cComponentMethodsParamsTable[23], 0, 0,
+    cCompMethodFindComponent,      cCompMethodFindComponent,      fftObject,  1, &cComponentMethodsParamsTable[28], 0, 0,
+    cCompMethodSave,               cCompMethodSave,               fftNone,    1, &cComponentMethodsParamsTable[29], 0, 0,
+    cCompMethodWriteTo,            cCompMethodWriteTo,            fftNone,    1, &cComponentMethodsParamsTable[30], 0, 0,
+    cCompMethodBeginOutput,        cCompMethodBeginOutput,        fftNone,    0,                                 0, 0, 0,
+    cCompMethodNextOutputChunk,    cCompMethodNextOutputChunk,    fftBinary,  1, &cComponentMethodsParamsTable[31], 0, 0,
+    cCompMethodSaveSnapshot,       cCompMethodSaveSnapshot,       fftNone,    2, &cComponentMethodsParamsTable[32], 0, 0,
+    cCompMethodLoadSnapshot,       cCompMethodLoadSnapshot,       fftNone,    2, &cComponentMethodsParamsTable[34], 0, 0,
+    cCompMethodLoadJCal,           cCompMethodLoadJCal,           fftNone,    1, &cComponentMethodsParamsTable[36], 0, 0,
+    cCompMethodExpandInstances,    cCompMethodExpandInstances,    fftList,    2, &cComponentMethodsParamsTable[37], 0, 0
 };
 
 // List of methods
@@ -274,6 +330,42 @@ qlong NVObjComponent::methodCall( tThreadData* pThreadData )
 			pThreadData->mCurMethodName = "$listToProperty";
 			result = methodListToProperty(pThreadData, paramCount);
 			break;
+        case cCompMethodFindComponent:
+			pThreadData->mCurMethodName = "$findComponent";
+			result = methodFindComponent(pThreadData, paramCount);
+			break;
+        case cCompMethodSave:
+			pThreadData->mCurMethodName = "$save";
+			result = methodSave(pThreadData, paramCount);
+			break;
+        case cCompMethodWriteTo:
+			pThreadData->mCurMethodName = "$writeTo";
+			result = methodWriteTo(pThreadData, paramCount);
+			break;
+        case cCompMethodBeginOutput:
+			pThreadData->mCurMethodName = "$beginOutput";
+			result = methodBeginOutput(pThreadData, paramCount);
+			break;
+        case cCompMethodNextOutputChunk:
+			pThreadData->mCurMethodName = "$nextOutputChunk";
+			result = methodNextOutputChunk(pThreadData, paramCount);
+			break;
+        case cCompMethodSaveSnapshot:
+			pThreadData->mCurMethodName = "$saveSnapshot";
+			result = methodSaveSnapshot(pThreadData, paramCount);
+			break;
+        case cCompMethodLoadSnapshot:
+			pThreadData->mCurMethodName = "$loadSnapshot";
+			result = methodLoadSnapshot(pThreadData, paramCount);
+			break;
+        case cCompMethodLoadJCal:
+			pThreadData->mCurMethodName = "$loadJCal";
+			result = methodLoadJCal(pThreadData, paramCount);
+			break;
+        case cCompMethodExpandInstances:
+			pThreadData->mCurMethodName = "$expandInstances";
+			result = methodExpandInstances(pThreadData, paramCount);
+			break;
 	}
 	
 	callErrorMethod(pThreadData, result);
@@ -311,7 +403,8 @@ const static qshort cCompPropertyType             = 2400,
                     cCompPropertyDateStartObj     = 2422,
                     cCompPropertyDateEndObj       = 2423,
                     cCompPropertyDueObj           = 2424,
-                    cCompPropertyDateStampObj     = 2425;
+                    cCompPropertyDateStampObj     = 2425,
+                    cCompPropertyJCalOutput       = 2426;
 
 // Table of properties available from Simple
 // Columns are:
@@ -349,7 +442,8 @@ ECOproperty cComponentPropertyTable[] =
     cCompPropertyDateStartObj,     cCompPropertyDateStartObj,     fftObject,    EXTD_FLAG_PROPCUSTOM, 0, 0, 0,
     cCompPropertyDateEndObj,       cCompPropertyDateEndObj,       fftObject,    EXTD_FLAG_PROPCUSTOM, 0, 0, 0,
     cCompPropertyDueObj,           cCompPropertyDueObj,           fftObject,    EXTD_FLAG_PROPCUSTOM, 0, 0, 0,
-    cCompPropertyDateStampObj,     cCompPropertyDateStampObj,     fftObject,    EXTD_FLAG_PROPCUSTOM, 0, 0, 0
+    cCompPropertyDateStampObj,     cCompPropertyDateStampObj,     fftObject,    EXTD_FLAG_PROPCUSTOM, 0, 0, 0,
+    cCompPropertyJCalOutput,       cCompPropertyJCalOutput,       fftCharacter, EXTD_FLAG_PROPCUSTOM, 0, 0, 0
 };
 
 // List of properties in Simple
@@ -393,6 +487,7 @@ qlong NVObjComponent::canAssignProperty( tThreadData* pThreadData, qlong propID
         case cCompPropertyDateEndObj:
         case cCompPropertyDueObj:
         case cCompPropertyDateStampObj:
+        case cCompPropertyJCalOutput:
 			return qfalse;
             
 		default:
@@ -423,6 +518,8 @@ qlong NVObjComponent::getProperty( tThreadData* pThreadData )
     
     NVObjDate* newDate = 0;
     
+    std::string jcalAssign;
+    
     qlong propID = ECOgetId( pThreadData->mEci );
 	switch( propID ) {
 		case cCompPropertyType:
@@ -441,7 +538,11 @@ qlong NVObjComponent::getProperty( tThreadData* pThreadData )
                     compTypeSearch = compTypeLookup.get(typeTest);
                 } 
             }
-            getEXTFldValFromInt(fValReturn, icalcomponent_count_components(comp.get(), compTypeSearch));
+            if (lazyIndex && lazyIndex->isLazy()) {
+                getEXTFldValFromInt(fValReturn, lazyIndex->count(compTypeSearch));
+            } else {
+                getEXTFldValFromInt(fValReturn, icalcomponent_count_components(comp.get(), compTypeSearch));
+            }
             break;
             
         case cCompPropertyPropertyCount:
@@ -460,10 +561,18 @@ qlong NVObjComponent::getProperty( tThreadData* pThreadData )
             break;
             
         case cCompPropertyICSOutput:
+            materializeComponents();
             getEXTFldValFromChar(fValReturn, icalcomponent_as_ical_string(comp.get()));
             break;
             
+        case cCompPropertyJCalOutput:
+            materializeComponents();
+            writeJCal(comp.get(), jcalAssign);
+            getEXTFldValFromString(fValReturn, jcalAssign);
+            break;
+            
         case cCompPropertyCurrentComponent:
+            materializeComponents();
             compAssign = icalcomponent_get_current_component(comp.get());
             if (compAssign) {
                 // Create new Omnis object and set pointer for Omnis object
@@ -585,11 +694,14 @@ qlong NVObjComponent::setProperty( tThreadData* pThreadData )
  **************************************************************************************************/
 
 icalcomponent* NVObjComponent::getComponent() {
+    materializeComponents();
     return comp.get();
 }
 
 void NVObjComponent::setComponent(icalcomponent* c, shared_ptr<icalcomponent> pc) {
+    endOutput();
     parentComp = pc;
+    lazyIndex.reset();
     
     if (pc) {
         comp = shared_ptr<icalcomponent>(c, KeepComponent);
@@ -598,6 +710,19 @@ void NVObjComponent::setComponent(icalcomponent* c, shared_ptr<icalcomponent> pc
     }
 }
 
+// The output cursor holds pointers to the properties and children still to be written, so any change through this 
+// object ends the output.  Changes made through other objects holding part of the same component aren't seen.
+void NVObjComponent::endOutput() {
+    outputCursor.reset();
+}
+
+void NVObjComponent::materializeComponents() {
+    if (lazyIndex) {
+        lazyIndex->materializeAll();
+        lazyIndex.reset();
+    }
+}
+
 /**************************************************************************************************
  **                              CUSTOM (YOUR) METHODS                                           **
  **************************************************************************************************/
@@ -653,7 +778,7 @@ char* read_stream(char *s, size_t size, void *d) {
 // This method loads the contents of an ICS file into the current component
 tResult NVObjComponent::methodLoad( tThreadData* pThreadData, qshort pParamCount )
 { 
-    EXTfldval pathVal;
+    EXTfldval pathVal, modeVal;
     
     // Parameter 1: Path of ICS file
     if ( getParamVar(pThreadData, 1, pathVal) != qtrue ) {
@@ -666,29 +791,77 @@ tResult NVObjComponent::methodLoad( tThreadData* pThreadData, qshort pParamCount
     }
     std::string pathString = getStringFromEXTFldVal(pathVal);
     
+    // Parameter 2: (Optional) Load mode
+    LoadMode loadMode = LOAD_STANDARD;
+    if ( pParamCount >= 2 && getParamVar(pThreadData, 2, modeVal) == qtrue ) {
+        loadMode = getICalTypeFromEXTFldVal<LoadMode>(modeVal);
+    }
+    
     // Create a new parser object
     shared_ptr<icalparser> parser = shared_ptr<icalparser>(icalparser_new(), icalparser_free);
     
-    // Open the file for reading
-    shared_ptr<FILE> stream = shared_ptr<FILE>(fopen(pathString.c_str(),"r"), fclose);
-    if (!stream) {
-        pThreadData->mExtraErrorText = str(format("Unable to load file \"%s\"") % pathString);
-        return ERR_METHOD_FAILED;
+    if (loadMode == LOAD_LAZY) {
+        // Keep the file mapped and only parse children when they're reached (Falls back to a standard load if the file can't be mapped)
+        shared_ptr<MappedFile> lazyFile(new MappedFile());
+        if (lazyFile->open(pathString)) {
+            shared_ptr<LazyComponentIndex> index = LazyComponentIndex::create(lazyFile);
+            if (!index) {
+                pThreadData->mExtraErrorText = str(format("Unable to load component from file \"%s\"") % pathString);
+                return ERR_METHOD_FAILED;
+            }
+            
+            setComponent(index->getRoot());
+            lazyIndex = index;
+            
+            return METHOD_DONE_RETURN;
+        }
     }
     
-    // Tell the parser what input routine it should use.
-    icalparser_set_gen_data(parser.get(),stream.get());
-    
-    // Read file
-    char* line;
-    icalcomponent* c;
-    do {
-        // Get a single content line by making one or more calls to read_stream()
-        line = icalparser_get_line(parser.get(),read_stream);
+    icalcomponent* c = 0;
+    MappedFile mappedFile;
+    if ((loadMode == LOAD_MAPPED || loadMode == LOAD_PARALLEL) && mappedFile.open(pathString)) {
+        // Feed the parser straight from the mapped file.  Lines are unfolded and terminated in place 
+        // (The mapping is private, so the file itself is untouched).
+        char* pos = mappedFile.data();
+        char* end = mappedFile.data() + mappedFile.size();
+        if (loadMode == LOAD_PARALLEL) {
+            c = parseComponentParallel(pos, end);
+            
+            // Something didn't parse on its own, so map the file again and parse it serially to keep the errors
+            if (!c && mappedFile.open(pathString)) {
+                pos = mappedFile.data();
+                end = mappedFile.data() + mappedFile.size();
+                c = parseContentLines(parser.get(), pos, end);
+            }
+        } else {
+            c = parseContentLines(parser.get(), pos, end);
+        }
+    } else {
+        // Open the file for reading (Also used for files that can't be mapped, e.g. pipes)
+        shared_ptr<FILE> stream = shared_ptr<FILE>(fopen(pathString.c_str(),"r"), fclose);
+        if (!stream) {
+            pThreadData->mExtraErrorText = str(format("Unable to load file \"%s\"") % pathString);
+            return ERR_METHOD_FAILED;
+        }
+        
+        // Tell the parser what input routine it should use.
+        icalparser_set_gen_data(parser.get(),stream.get());
         
-        // Assign the pointer
-        c = icalparser_add_line(parser.get(),line);
-    } while (line != 0 && !c);
+        // Read file
+        char* line;
+        do {
+            // Get a single content line by making one or more calls to read_stream()
+            line = icalparser_get_line(parser.get(),read_stream);
+            
+            // Assign the pointer
+            c = icalparser_add_line(parser.get(),line);
+            
+            // The parser copies what it needs, so the line can be released
+            if (line) {
+                free(line);
+            }
+        } while (line != 0 && !c);
+    }
     
     // At this point we either have a component or we hit the end of the file
     if (!c) {
@@ -702,6 +875,41 @@ tResult NVObjComponent::methodLoad( tThreadData* pThreadData, qshort pParamCount
     return METHOD_DONE_RETURN;
 }
 
+// Buffer reused by $loadText on each thread, so repeated loads don't reallocate.  Buffers that grow 
+// beyond kMaxRetainedTextBuffer are released after the load rather than kept for the life of the thread.
+static boost::thread_specific_ptr< std::vector<qchar> > loadTextBuffer;
+static const size_t kMaxRetainedTextBuffer = 4 * 1024 * 1024;
+
+// UTF8 contents of a text parameter in this thread's buffer, without any byte order mark.  Binary fields are used 
+// as-is, character fields are converted in a single pass.  The buffer is released once this goes out of scope if it 
+// has grown too big to keep.
+class LoadTextBuffer {
+public:
+    LoadTextBuffer(EXTfldval& textVal) {
+        if (!loadTextBuffer.get()) {
+            loadTextBuffer.reset(new std::vector<qchar>());
+        }
+        
+        qlong length = 0;
+        pos = getUtf8FromEXTFldVal(textVal, *loadTextBuffer, length);
+        end = pos + length;
+        
+        // Skip a UTF8 byte order mark
+        if (length >= 3 && static_cast<unsigned char>(pos[0]) == 0xEF && static_cast<unsigned char>(pos[1]) == 0xBB && static_cast<unsigned char>(pos[2]) == 0xBF) {
+            pos += 3;
+        }
+    }
+    
+    ~LoadTextBuffer() {
+        if (loadTextBuffer->capacity() * sizeof(qchar) > kMaxRetainedTextBuffer) {
+            loadTextBuffer.reset();
+        }
+    }
+    
+    char* pos;
+    char* end;
+};
+
 // This method loads a string of ICS data into the current component
 tResult NVObjComponent::methodLoadText( tThreadData* pThreadData, qshort pParamCount )
 { 
@@ -712,9 +920,11 @@ tResult NVObjComponent::methodLoadText( tThreadData* pThreadData, qshort pParamC
         return ERR_BAD_PARAMS;
 	}
     
-    // Convert to UTF8 string and get new component
-    std::string inString = getStringFromEXTFldVal(icsVar);
-    icalcomponent* c = icalcomponent_new_from_string(inString.c_str());
+    // Parse the buffer in place (Several components come back inside an XROOT, as icalcomponent_new_from_string does)
+    LoadTextBuffer text(icsVar);
+    shared_ptr<icalparser> parser = shared_ptr<icalparser>(icalparser_new(), icalparser_free);
+    icalcomponent* c = parseAllContentLines(parser.get(), text.pos, text.end);
+    
     if (!c) {
         pThreadData->mExtraErrorText = str(format("Unable to create new component from libical. Error: %s") % icalerror_strerror(icalerrno));
         return ERR_METHOD_FAILED;
@@ -727,6 +937,31 @@ tResult NVObjComponent::methodLoadText( tThreadData* pThreadData, qshort pParamC
 }
 
 
+// This method loads jCal (RFC 7265) JSON into the current component
+tResult NVObjComponent::methodLoadJCal( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    // Read parameter
+    EXTfldval jcalVar;
+    if ( getParamVar(pThreadData, 1, jcalVar) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, jCal Contents, is unrecognized. Expected character field containing jCal data.";
+        return ERR_BAD_PARAMS;
+	}
+    
+    LoadTextBuffer text(jcalVar);
+    std::string errorText;
+    icalcomponent* c = parseJCal(text.pos, text.end, errorText);
+    
+    if (!c) {
+        pThreadData->mExtraErrorText = str(format("Unable to load jCal. Error: %s") % errorText);
+        return ERR_METHOD_FAILED;
+    }
+    
+    // Assign shared_ptr for current component
+    setComponent(c);
+    
+    return METHOD_DONE_RETURN;
+}
+
 // This method returns the first child component in the component.
 tResult NVObjComponent::methodFirstComponent( tThreadData* pThreadData, qshort pParamCount )
 { 
@@ -751,7 +986,13 @@ tResult NVObjComponent::methodFirstComponent( tThreadData* pThreadData, qshort p
     
     // Get first component and set the return value (if a value is found)
     NVObjComponent *newComp = 0;
-    icalcomponent* first = icalcomponent_get_first_component(comp.get(), filterType);
+    icalcomponent* first = 0;
+    if (lazyIndex && lazyIndex->isLazy()) {
+        lazyIndex->cursor = lazyIndex->find(filterType, 0);
+        first = lazyIndex->getComponent(lazyIndex->cursor);
+    } else {
+        first = icalcomponent_get_first_component(comp.get(), filterType);
+    }
     if (first) {
         // Create new Omnis object and set pointer for Omnis object
         newComp = createNVObj<NVObjComponent>(pThreadData);
@@ -790,7 +1031,15 @@ tResult NVObjComponent::methodNextComponent( tThreadData* pThreadData, qshort pP
     
     // Get next component and set the return value (if a value is found)
     NVObjComponent *newComp = 0;
-    icalcomponent* next = icalcomponent_get_next_component(comp.get(), filterType);
+    icalcomponent* next = 0;
+    if (lazyIndex && lazyIndex->isLazy()) {
+        if (lazyIndex->cursor != LazyComponentIndex::npos) {
+            lazyIndex->cursor = lazyIndex->find(filterType, lazyIndex->cursor + 1);
+            next = lazyIndex->getComponent(lazyIndex->cursor);
+        }
+    } else {
+        next = icalcomponent_get_next_component(comp.get(), filterType);
+    }
     if (next) {
         // Create new Omnis object and set pointer for Omnis object
         newComp = createNVObj<NVObjComponent>(pThreadData);
@@ -890,6 +1139,7 @@ tResult NVObjComponent::methodCheckRestrictions( tThreadData* pThreadData, qshor
         pThreadData->mExtraErrorText = "Object not initialized";
         return ERR_METHOD_FAILED;
     }
+    materializeComponents();
     
     int errors = icalcomponent_check_restrictions(comp.get());
     
@@ -908,6 +1158,8 @@ tResult NVObjComponent::methodStripErrors( tThreadData* pThreadData, qshort pPar
         pThreadData->mExtraErrorText = "Object not initialized";
         return ERR_METHOD_FAILED;
     }
+    materializeComponents();
+    endOutput();
     
     icalcomponent_strip_errors(comp.get());
 
@@ -921,6 +1173,8 @@ tResult NVObjComponent::methodAddComponent( tThreadData* pThreadData, qshort pPa
         pThreadData->mExtraErrorText = "Object not initialized";
         return ERR_METHOD_FAILED;
     }
+    materializeComponents();
+    endOutput();
     
     // Parameter 1: Component object to add as child
     EXTfldval compVal;
@@ -955,6 +1209,8 @@ tResult NVObjComponent::methodRemoveComponent( tThreadData* pThreadData, qshort
         pThreadData->mExtraErrorText = "Object not initialized";
         return ERR_METHOD_FAILED;
     }
+    materializeComponents();
+    endOutput();
     
     // Parameter 1: Component object to remove
     EXTfldval compVal;
@@ -968,7 +1224,8 @@ tResult NVObjComponent::methodRemoveComponent( tThreadData* pThreadData, qshort
         return ERR_BAD_PARAMS;
     }
     
-    // Remove the component
+    // Remove the component, which frees the zone of a VTIMEZONE
+    ZoneCache::instance().forgetZones(compParam->getComponent());
     icalcomponent_remove_component(comp.get(), compParam->getComponent());
     
     // Alter the object to be empty  (This will destruct the instance compParam NVObjComponent instance)
@@ -987,6 +1244,7 @@ tResult NVObjComponent::methodAddProperty( tThreadData* pThreadData, qshort pPar
         pThreadData->mExtraErrorText = "Object not initialized";
         return ERR_METHOD_FAILED;
     }
+    endOutput();
     
     // Parameter 1: Property object to add
     EXTfldval propVal;
@@ -1021,6 +1279,7 @@ tResult NVObjComponent::methodRemoveProperty( tThreadData* pThreadData, qshort p
         pThreadData->mExtraErrorText = "Object not initialized";
         return ERR_METHOD_FAILED;
     }
+    endOutput();
     
     // Parameter 1: Property object to remove
     EXTfldval propVal;
@@ -1307,6 +1566,7 @@ tResult NVObjComponent::methodListToProperty( tThreadData* pThreadData, qshort p
         pThreadData->mExtraErrorText = "Object not initialized";
         return ERR_METHOD_FAILED;
     }
+    endOutput();
     
     // Parameter 1: List to read properties from
     EXTqlist listVal;
@@ -1455,4 +1715,396 @@ tResult NVObjComponent::methodListToProperty( tThreadData* pThreadData, qshort p
     return METHOD_DONE_RETURN;
 }
 
+// This method returns the first child component with a UID.  Children deferred by kCalLoadLazy are found from their index entry, so only the match is parsed.
+tResult NVObjComponent::methodFindComponent( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    if (!comp) {
+        pThreadData->mExtraErrorText = "Object not initialized";
+        return ERR_METHOD_FAILED;
+    }
+    
+    // Parameter 1: UID to look for
+    EXTfldval uidVal;
+    if ( getParamVar(pThreadData, 1, uidVal) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, uid, is unrecognized. Expected character UID.";
+        return ERR_BAD_PARAMS;
+	}
+    std::string uidString = getStringFromEXTFldVal(uidVal);
+    
+    icalcomponent* found = 0;
+    if (lazyIndex && lazyIndex->isLazy()) {
+        found = lazyIndex->getComponent(lazyIndex->findUID(uidString, 0));
+    } else {
+        // Walk the children directly so the component's own iterator isn't disturbed
+        icalcompiter itr = icalcomponent_begin_component(comp.get(), ICAL_ANY_COMPONENT);
+        for (icalcomponent* child = icalcompiter_deref(&itr); child != 0 && !found; child = icalcompiter_next(&itr)) {
+            const char* childUID = icalcomponent_get_uid(child);
+            if (childUID && uidString == childUID) {
+                found = child;
+            }
+        }
+    }
+    
+    EXTfldval retVal;
+    if (found) {
+        NVObjComponent* newComp = createNVObj<NVObjComponent>(pThreadData);
+        if (newComp) {
+            newComp->setComponent(found, comp);
+            getEXTFldValForObj<NVObjComponent>(retVal, newComp);
+        }
+    }
+    
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
+
+
+
+
+// This method writes the component to an ICS file.  Content lines are written as they're generated rather than building the whole file in memory first.
+tResult NVObjComponent::methodSave( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    if (!comp) {
+        pThreadData->mExtraErrorText = "Object not initialized";
+        return ERR_METHOD_FAILED;
+    }
+    materializeComponents();
+    
+    // Parameter 1: Path of ICS file
+    EXTfldval pathVal;
+    if ( getParamVar(pThreadData, 1, pathVal) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, path, is unrecognized.  Expected file path.";
+        return ERR_BAD_PARAMS;
+	}
+    if( ensurePosixPath(pathVal) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, path, is unrecognized.  Expected file path.";
+        return ERR_BAD_PARAMS;
+    }
+    std::string pathString = getStringFromEXTFldVal(pathVal);
+    
+    // Open the file for writing (Binary so the CRLF line breaks are written as-is)
+    FILE* stream = fopen(pathString.c_str(),"wb");
+    if (!stream) {
+        pThreadData->mExtraErrorText = str(format("Unable to open file \"%s\" for writing") % pathString);
+        return ERR_METHOD_FAILED;
+    }
+    
+    FileICSWriter writer(stream);
+    writer.writeComponent(comp.get());
+    bool written = writer.flush();
+    
+    // Closed here rather than left to a deleter, since fclose can be the first to report a failed write (e.g. a full disk)
+    if (fclose(stream) != 0 || !written) {
+        pThreadData->mExtraErrorText = str(format("Unable to write to file \"%s\"") % pathString);
+        return ERR_METHOD_FAILED;
+    }
+    
+    return METHOD_DONE_RETURN;
+}
 
+// This method writes the component as UTF-8 ICS data into a binary variable
+tResult NVObjComponent::methodWriteTo( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    if (!comp) {
+        pThreadData->mExtraErrorText = "Object not initialized";
+        return ERR_METHOD_FAILED;
+    }
+    materializeComponents();
+    
+    // Parameter 1: Binary variable to receive the data
+    EXTfldval binVal;
+    if ( getParamVar(pThreadData, 1, binVal) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, binaryVar, is unrecognized.  Expected binary variable.";
+        return ERR_BAD_PARAMS;
+	}
+    
+    // Content lines are appended straight to the output bytes (No intermediate ICS string or character conversion)
+    std::vector<char> output;
+    BufferICSWriter writer(output);
+    writer.writeComponent(comp.get());
+    writer.flush();
+    
+    if (output.empty()) {
+        binVal.setEmpty(fftBinary, dpDefault);
+    } else {
+        binVal.setBinary(fftBinary, reinterpret_cast<qbyte*>(&output[0]), static_cast<qlong>(output.size()));
+    }
+    
+    // Mark the parameter as changed
+    ECOsetParameterChanged( pThreadData->mEci, 1 );
+    
+    return METHOD_DONE_RETURN;
+}
+
+// Chunk size used when $nextOutputChunk isn't passed one
+const static qlong kDefaultOutputChunk = 65536;
+
+// This method starts chunked output of the component.  Use $nextOutputChunk to get the ICS data.
+tResult NVObjComponent::methodBeginOutput( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    if (!comp) {
+        pThreadData->mExtraErrorText = "Object not initialized";
+        return ERR_METHOD_FAILED;
+    }
+    materializeComponents();
+    
+    outputCursor = shared_ptr<ICSOutputCursor>(new ICSOutputCursor(comp));
+    
+    return METHOD_DONE_RETURN;
+}
+
+// This method returns the next chunk of UTF-8 ICS data after $beginOutput.  Returns empty binary once all the data has been returned.
+tResult NVObjComponent::methodNextOutputChunk( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    if (!outputCursor) {
+        pThreadData->mExtraErrorText = "No output in progress.  Call $beginOutput first (Changing the component ends the output).";
+        return ERR_METHOD_FAILED;
+    }
+    
+    // Parameter 1: (Optional) Largest chunk to return
+    qlong maxBytes = kDefaultOutputChunk;
+    if ( pParamCount >= 1 && getParamLong(pThreadData, 1, maxBytes) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, maxBytes, is unrecognized.  Expected a positive integer.";
+        return ERR_BAD_PARAMS;
+    }
+    if (maxBytes <= 0) {
+        pThreadData->mExtraErrorText = "First parameter, maxBytes, is unrecognized.  Expected a positive integer.";
+        return ERR_BAD_PARAMS;
+    }
+    
+    std::vector<char> chunk;
+    EXTfldval retVal;
+    if (outputCursor->nextChunk(static_cast<std::size_t>(maxBytes), chunk)) {
+        retVal.setBinary(fftBinary, reinterpret_cast<qbyte*>(&chunk[0]), static_cast<qlong>(chunk.size()));
+    } else {
+        // Finished
+        outputCursor.reset();
+        retVal.setEmpty(fftBinary, dpDefault);
+    }
+    
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
+
+// Read an optional file path parameter.  Returns false if the parameter was passed but isn't a path.
+static bool getOptionalPathParam( tThreadData* pThreadData, qshort pParamCount, qshort paramNum, std::string& path )
+{
+    EXTfldval pathVal;
+    path.clear();
+    if ( pParamCount < paramNum || getParamVar(pThreadData, paramNum, pathVal) != qtrue || getStringFromEXTFldVal(pathVal).empty() ) {
+        return true;
+    }
+    if( ensurePosixPath(pathVal) != qtrue ) {
+        return false;
+    }
+    path = getStringFromEXTFldVal(pathVal);
+    return true;
+}
+
+// This method writes the component to a binary snapshot, which $loadSnapshot can read back without parsing ICS text.
+// If the ICS file the component was loaded from is passed, $loadSnapshot can tell when the snapshot is out of date.
+tResult NVObjComponent::methodSaveSnapshot( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    if (!comp) {
+        pThreadData->mExtraErrorText = "Object not initialized";
+        return ERR_METHOD_FAILED;
+    }
+    materializeComponents();
+    
+    // Parameter 1: Path of snapshot file
+    EXTfldval pathVal;
+    if ( getParamVar(pThreadData, 1, pathVal) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, path, is unrecognized.  Expected file path.";
+        return ERR_BAD_PARAMS;
+	}
+    if( ensurePosixPath(pathVal) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, path, is unrecognized.  Expected file path.";
+        return ERR_BAD_PARAMS;
+    }
+    std::string pathString = getStringFromEXTFldVal(pathVal);
+    
+    // Parameter 2: (Optional) Path of the source ICS file
+    std::string sourceString;
+    if ( !getOptionalPathParam(pThreadData, pParamCount, 2, sourceString) ) {
+        pThreadData->mExtraErrorText = "Second parameter, sourcePath, is unrecognized.  Expected file path.";
+        return ERR_BAD_PARAMS;
+    }
+    
+    SnapshotSource source;
+    if ( !sourceString.empty() && !getSnapshotSource(sourceString, source) ) {
+        pThreadData->mExtraErrorText = str(format("Unable to read file \"%s\"") % sourceString);
+        return ERR_METHOD_FAILED;
+    }
+    
+    if ( !saveSnapshot(comp.get(), pathString, source) ) {
+        pThreadData->mExtraErrorText = str(format("Unable to write snapshot \"%s\"") % pathString);
+        return ERR_METHOD_FAILED;
+    }
+    
+    return METHOD_DONE_RETURN;
+}
+
+// This method loads a snapshot written by $saveSnapshot into the current component.  If the ICS file path is passed, 
+// the snapshot is only used when it was saved from the current version of that file.  Otherwise the ICS file is 
+// loaded instead and the snapshot is rewritten from it.
+tResult NVObjComponent::methodLoadSnapshot( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    // Parameter 1: Path of snapshot file
+    EXTfldval pathVal;
+    if ( getParamVar(pThreadData, 1, pathVal) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, path, is unrecognized.  Expected file path.";
+        return ERR_BAD_PARAMS;
+	}
+    if( ensurePosixPath(pathVal) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, path, is unrecognized.  Expected file path.";
+        return ERR_BAD_PARAMS;
+    }
+    std::string pathString = getStringFromEXTFldVal(pathVal);
+    
+    // Parameter 2: (Optional) Path of the source ICS file
+    std::string icsString;
+    if ( !getOptionalPathParam(pThreadData, pParamCount, 2, icsString) ) {
+        pThreadData->mExtraErrorText = "Second parameter, icsPath, is unrecognized.  Expected file path.";
+        return ERR_BAD_PARAMS;
+    }
+    
+    SnapshotSource source;
+    if ( !icsString.empty() && !getSnapshotSource(icsString, source) ) {
+        pThreadData->mExtraErrorText = str(format("Unable to load file \"%s\"") % icsString);
+        return ERR_METHOD_FAILED;
+    }
+    
+    icalcomponent* c = loadSnapshot(pathString, source);
+    if (c) {
+        setComponent(c);
+        return METHOD_DONE_RETURN;
+    }
+    
+    if (icsString.empty()) {
+        pThreadData->mExtraErrorText = str(format("Unable to load snapshot \"%s\"") % pathString);
+        return ERR_METHOD_FAILED;
+    }
+    
+    // The snapshot is missing, damaged or stale, so parse the ICS file
+    MappedFile mappedFile;
+    if (!mappedFile.open(icsString)) {
+        pThreadData->mExtraErrorText = str(format("Unable to load file \"%s\"") % icsString);
+        return ERR_METHOD_FAILED;
+    }
+    shared_ptr<icalparser> parser = shared_ptr<icalparser>(icalparser_new(), icalparser_free);
+    char* pos = mappedFile.data();
+    char* end = mappedFile.data() + mappedFile.size();
+    c = parseContentLines(parser.get(), pos, end);
+    if (!c) {
+        pThreadData->mExtraErrorText = str(format("Unable to load component from file \"%s\"") % icsString);
+        return ERR_METHOD_FAILED;
+    }
+    setComponent(c);
+    
+    // Replace the snapshot for next time.  Failing to write it doesn't fail the load.
+    saveSnapshot(c, pathString, source);
+    
+    return METHOD_DONE_RETURN;
+}
+
+// Read a date parameter.  Omnis dates are in the system time zone; Date objects keep their own zone.
+static bool getDateParam( tThreadData* pThreadData, qshort paramNum, icaltimetype& tt )
+{
+    EXTfldval dateVal;
+    if ( getParamVar(pThreadData, paramNum, dateVal) != qtrue ) {
+        return false;
+    }
+    
+    return getZonedTimeTypeFromEXTFldVal(pThreadData, dateVal, tt);
+}
+
+// This method expands the events in the component into the instances between two dates.  Returns a list of UID, Start, 
+// End, RecurrenceID and Override, sorted by start.  Times are returned in the zone of the From date.
+tResult NVObjComponent::methodExpandInstances( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    if (!comp) {
+        pThreadData->mExtraErrorText = "Object not initialized";
+        return ERR_METHOD_FAILED;
+    }
+    materializeComponents();
+    
+    // Parameter 1: From date
+    icaltimetype fromDate, toDate;
+    if ( !getDateParam(pThreadData, 1, fromDate) ) {
+        pThreadData->mExtraErrorText = "First parameter, fromDate, is unrecognized.  Expected Omnis date or Date object.";
+        return ERR_BAD_PARAMS;
+    }
+    
+    // Parameter 2: To date
+    if ( !getDateParam(pThreadData, 2, toDate) ) {
+        pThreadData->mExtraErrorText = "Second parameter, toDate, is unrecognized.  Expected Omnis date or Date object.";
+        return ERR_BAD_PARAMS;
+    }
+    
+    // Results (And floating times) are in the zone of the From date
+    SystemTimeZone curZone;
+    icaltimezone* outZone = const_cast<icaltimezone*>(fromDate.zone);
+    if (fromDate.is_utc) {
+        outZone = icaltimezone_get_utc_timezone();
+    } else if (!outZone) {
+        outZone = icaltimezone_get_builtin_timezone(curZone.name().c_str());
+    }
+    icaltimezone* toZone = const_cast<icaltimezone*>(toDate.zone);
+    if (toDate.is_utc) {
+        toZone = icaltimezone_get_utc_timezone();
+    } else if (!toZone) {
+        toZone = outZone;
+    }
+    
+    ZoneTransitions outTransitions(outZone);
+    ZoneTransitions toTransitions(toZone);
+    std::vector<ExpandedInstance> instances;
+    expandInstances(comp.get(), outTransitions.asTimet(fromDate), toTransitions.asTimet(toDate), outZone, instances);
+    
+    // Create list
+    EXTqlist* retList = new EXTqlist(listVlen);
+    str255 colName;
+    
+    colName = initStr255("UID");
+    retList->addCol(fftCharacter,dpFcharacter,10000000,&colName);
+    colName = initStr255("Start");
+    retList->addCol(fftDate,dpFdtimeC,0,&colName);
+    colName = initStr255("End");
+    retList->addCol(fftDate,dpFdtimeC,0,&colName);
+    colName = initStr255("RecurrenceID");
+    retList->addCol(fftDate,dpFdtimeC,0,&colName);
+    colName = initStr255("Override");
+    retList->addCol(fftBoolean,dpDefault,0,&colName);
+    
+    EXTfldval colVal;
+    qlong row = 0;
+    for (std::vector<ExpandedInstance>::iterator it = instances.begin(); it != instances.end(); ++it) {
+        retList->insertRow();
+        ++row;
+        
+        retList->getColValRef(row, 1, colVal, qtrue);
+        getEXTFldValFromiCalChar(colVal, it->uid);
+        
+        retList->getColValRef(row, 2, colVal, qtrue);
+        getEXTFldValFromTimeType(colVal, outTransitions.fromTimet(it->start, it->isDate), qfalse, pThreadData);
+        
+        retList->getColValRef(row, 3, colVal, qtrue);
+        getEXTFldValFromTimeType(colVal, outTransitions.fromTimet(it->end, it->isDate), qfalse, pThreadData);
+        
+        if (it->hasRecurrenceId) {
+            retList->getColValRef(row, 4, colVal, qtrue);
+            getEXTFldValFromTimeType(colVal, outTransitions.fromTimet(it->recurrenceId, it->isDate), qfalse, pThreadData);
+        }
+        
+        retList->getColValRef(row, 5, colVal, qtrue);
+        getEXTFldValFromBool(colVal, it->isOverride);
+    }
+    
+    EXTfldval retVal;
+    retVal.setList(retList,qtrue);
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
\ No newline at end of file
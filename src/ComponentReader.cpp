@@ -0,0 +1,414 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <extcomp.he>
+#include "ComponentReader.he"
+#include "Component.he"
+#include "Constants.he"
+#include "iCalTools.he"
+
+// free and strlen
+#include <stdlib.h>
+#include <string.h>
+
+#include <boost/format.hpp>
+#include <boost/algorithm/string.hpp>
+
+using namespace OmnisTools;
+using namespace iCalTools;
+using namespace LibiCalConstants;
+using boost::shared_ptr;
+using boost::format;
+
+// Line reader for the parser (Defined in Component.cpp)
+char* read_stream(char *s, size_t size, void *d);
+
+/**************************************************************************************************
+ **                       CONSTRUCTORS / DESTRUCTORS                                             **
+ **************************************************************************************************/
+
+NVObjComponentReader::NVObjComponentReader(qobjinst objinst, tThreadData *pThreadData) : NVObjBase(objinst), state(new ReaderState)
+{ }
+
+NVObjComponentReader::~NVObjComponentReader()
+{ }
+
+/**************************************************************************************************
+ **                                    COPY                                                      **
+ **************************************************************************************************/
+
+void NVObjComponentReader::copy( NVObjComponentReader* pObj ) {
+    NVObjBase::copy(pObj);
+    
+    state = pObj->state;
+}
+
+/**************************************************************************************************
+ **                               METHOD DECLERATION                                             **
+ **************************************************************************************************/
+
+// This is where the resource # of the methods is defined.  In this project is also used as the Unique ID.
+const static qshort cReaderMethodError         = 17000,
+                    cReaderMethodOpen          = 17001,
+                    cReaderMethodNextComponent = 17002,
+                    cReaderMethodClose         = 17003;
+
+
+// Table of parameter resources and types.
+// Note that all parameters can be stored in this single table and the array offset can be  
+// passed via the MethodsTable.
+//
+// Columns are:
+// 1) Name of Parameter (Resource #)
+// 2) Return type (fft value)
+// 3) Parameter flags of type EXTD_FLAG_xxxx
+// 4) Extended flags.  Documentation states, "Must be 0"
+ECOparam cReaderMethodsParamsTable[] = 
+{
+	// $error
+    17800, fftInteger  , 0, 0,
+	17801, fftCharacter, 0, 0,
+	17802, fftCharacter, 0, 0,
+	17803, fftCharacter, 0, 0,
+    // $open
+	17804, fftCharacter, 0, 0,
+    // $nextComponent
+    17805, fftConstant,  EXTD_FLAG_PARAMOPT, 0
+};
+
+// Table of Methods available
+// Columns are:
+// 1) Unique ID 
+// 2) Name of Method (Resource #)
+// 3) Return Type 
+// 4) # of Parameters
+// 5) Array of Parameter Names (Taken from MethodsParamsTable.  Increments # of parameters past this pointer) 
+// 6) Enum Start (Not sure what this does, 0 = disabled)
+// 7) Enum Stop (Not sure what this does, 0 = disabled)
+ECOmethodEvent cReaderMethodsTable[] = 
+{
+	cReaderMethodError,         cReaderMethodError,         fftNumber, 4, &cReaderMethodsParamsTable[0], 0, 0,
+	cReaderMethodOpen,          cReaderMethodOpen,          fftNone,   1, &cReaderMethodsParamsTable[4], 0, 0,
+    cReaderMethodNextComponent, cReaderMethodNextComponent, fftObject, 1, &cReaderMethodsParamsTable[5], 0, 0,
+    cReaderMethodClose,         cReaderMethodClose,         fftNone,   0,                             0, 0, 0
+};
+
+// List of methods
+qlong NVObjComponentReader::returnMethods(tThreadData* pThreadData)
+{
+	const qshort cReaderMethodCount = sizeof(cReaderMethodsTable) / sizeof(ECOmethodEvent);
+	
+	return ECOreturnMethods( gInstLib, pThreadData->mEci, &cReaderMethodsTable[0], cReaderMethodCount );
+}
+
+/**************************************************************************************************
+ **                                  METHOD CALL                                                 **
+ **************************************************************************************************/
+
+// Call a method
+qlong NVObjComponentReader::methodCall( tThreadData* pThreadData )
+{
+    tResult result = METHOD_OK;
+	qshort funcId = (qshort)ECOgetId(pThreadData->mEci);
+	qshort paramCount = ECOgetParamCount(pThreadData->mEci);
+    
+    switch( funcId )
+	{
+		case cReaderMethodError:
+			result = METHOD_OK; // Always return ok to prevent circular call to error.
+			break;
+		case cReaderMethodOpen:
+			pThreadData->mCurMethodName = "$open";
+			result = methodOpen(pThreadData, paramCount);
+			break;
+        case cReaderMethodNextComponent:
+			pThreadData->mCurMethodName = "$nextComponent";
+			result = methodNextComponent(pThreadData, paramCount);
+			break;
+        case cReaderMethodClose:
+			pThreadData->mCurMethodName = "$close";
+			result = methodClose(pThreadData, paramCount);
+			break;
+	}
+	
+	callErrorMethod(pThreadData, result);
+
+	return 0L;
+}
+
+/**************************************************************************************************
+ **                              PROPERTY DECLERATION                                            **
+ **************************************************************************************************/
+
+// This is where the resource # of the methods is defined.  In this project it is also used as the Unique ID.
+const static qshort cReaderPropertyCalendar       = 17400,
+                    cReaderPropertyComponentsRead = 17401,
+                    cReaderPropertyEndOfFile      = 17402;
+
+// Table of properties available
+// Columns are:
+// 1) Unique ID 
+// 2) Name of Property (Resource #)
+// 3) Return Type 
+// 4) Flags describing the property
+// 5) Additional Flags describing the property
+// 6) Enum Start (Not sure what this does, 0 = disabled)
+// 7) Enum Stop (Not sure what this does, 0 = disabled)
+ECOproperty cReaderPropertyTable[] = 
+{
+	cReaderPropertyCalendar,       cReaderPropertyCalendar,       fftObject,  EXTD_FLAG_PROPCUSTOM, 0, 0, 0,
+    cReaderPropertyComponentsRead, cReaderPropertyComponentsRead, fftInteger, EXTD_FLAG_PROPCUSTOM, 0, 0, 0,
+    cReaderPropertyEndOfFile,      cReaderPropertyEndOfFile,      fftBoolean, EXTD_FLAG_PROPCUSTOM, 0, 0, 0
+};
+
+// List of properties
+qlong NVObjComponentReader::returnProperties( tThreadData* pThreadData )
+{
+	const qshort propertyCount = sizeof(cReaderPropertyTable) / sizeof(ECOproperty);
+    
+	return ECOreturnProperties( gInstLib, pThreadData->mEci, &cReaderPropertyTable[0], propertyCount );
+}
+
+/**************************************************************************************************
+ **                                  PROPERTY CALL                                               **
+ **************************************************************************************************/
+
+// Assignability of properties
+qlong NVObjComponentReader::canAssignProperty( tThreadData* pThreadData, qlong propID ) {
+	switch (propID) {
+		case cReaderPropertyCalendar:
+        case cReaderPropertyComponentsRead:
+        case cReaderPropertyEndOfFile:
+			return qfalse;
+		default:
+			return qfalse;
+	}
+}
+
+// Method to retrieve a property of the object
+qlong NVObjComponentReader::getProperty( tThreadData* pThreadData ) 
+{
+	EXTfldval fValReturn;
+    NVObjComponent* newComp = 0;
+    icalcomponent* calendarCopy = 0;
+    
+    qlong propID = ECOgetId( pThreadData->mEci );
+	switch( propID ) {
+		case cReaderPropertyCalendar:
+            // Return a copy so the caller can keep it after the reader moves on
+            if (state->calendar) {
+                calendarCopy = icalcomponent_new_clone(state->calendar.get());
+                newComp = createNVObj<NVObjComponent>(pThreadData);
+                if (newComp) {
+                    newComp->setComponent(calendarCopy);
+                    getEXTFldValForObj<NVObjComponent>(fValReturn, newComp);
+                } else {
+                    icalcomponent_free(calendarCopy);
+                }
+            }
+			break;
+        case cReaderPropertyComponentsRead:
+            getEXTFldValFromInt(fValReturn, state->componentsRead);
+            break;
+        case cReaderPropertyEndOfFile:
+            getEXTFldValFromBool(fValReturn, (!state->stream || state->endOfFile));
+            break;
+	}
+    
+    ECOaddParam(pThreadData->mEci, &fValReturn); // Return to caller
+
+	return qtrue;
+}
+
+// Method to set a property of the object
+qlong NVObjComponentReader::setProperty( tThreadData* pThreadData )
+{
+	// Retrieve value to set for property, always in first parameter
+	EXTfldval fVal;
+	if( getParamVar( pThreadData->mEci, 1, fVal) == qfalse ) 
+		return qfalse;
+
+	// Assign to the appropriate property
+	qlong propID = ECOgetId( pThreadData->mEci );
+	switch( propID ) {
+		case cReaderPropertyCalendar:
+        case cReaderPropertyComponentsRead:
+        case cReaderPropertyEndOfFile:
+			break;
+	}
+
+	return 1L;
+}
+
+/**************************************************************************************************
+ **                                 INTERNAL METHODS                                             **
+ **************************************************************************************************/
+
+// Release the file and parser (For every copy of the reader)
+void NVObjComponentReader::close() {
+    *state = ReaderState();
+}
+
+// Read content lines until the next top-level component is complete.  VCALENDAR lines are kept out of the 
+// parser so each child is parsed as its own root; calendar properties are collected separately.
+icalcomponent* NVObjComponentReader::readComponent(icalcomponent_kind filterType) {
+    icalcomponent* c = 0;
+    icalproperty* prop;
+    char* line;
+    std::string compName;
+    ContentLineMarker marker;
+    
+    while (!c && (line = icalparser_get_line(state->parser.get(), read_stream)) != 0) {
+        marker = getContentLineMarker(line, line + strlen(line), &compName);
+        
+        if (state->childDepth == 0) {
+            if (boost::iequals(compName, "VCALENDAR")) {
+                if (marker == MARKER_BEGIN) {
+                    state->calendar = shared_ptr<icalcomponent>(icalcomponent_new(ICAL_VCALENDAR_COMPONENT), icalcomponent_free);
+                }
+            } else if (marker == MARKER_BEGIN) {
+                // Start of a child.  Components that weren't asked for are skipped without being parsed.
+                state->childDepth = 1;
+                state->skipChild = (filterType != ICAL_ANY_COMPONENT && icalcomponent_string_to_kind(compName.c_str()) != filterType);
+                if (!state->skipChild) {
+                    c = icalparser_add_line(state->parser.get(), line);
+                }
+            } else if (state->calendar && *line != '\0') {
+                // Calendar property (VERSION, PRODID, METHOD, etc.)
+                prop = icalproperty_new_from_string(line);
+                if (prop) {
+                    icalcomponent_add_property(state->calendar.get(), prop);
+                }
+            }
+        } else {
+            if (marker == MARKER_BEGIN) {
+                state->childDepth++;
+            } else if (marker == MARKER_END) {
+                state->childDepth--;
+            }
+            
+            if (!state->skipChild) {
+                c = icalparser_add_line(state->parser.get(), line);
+            }
+            
+            // The parser hands back the child once its END line is added
+            if (c || state->childDepth == 0) {
+                state->childDepth = 0;
+                state->skipChild = false;
+            }
+        }
+        
+        free(line);
+        compName.clear();
+    }
+    
+    if (!c) {
+        state->endOfFile = true;
+    }
+    
+    return c;
+}
+
+/**************************************************************************************************
+ **                              CUSTOM (YOUR) METHODS                                           **
+ **************************************************************************************************/
+
+// This method opens an ICS file for reading
+tResult NVObjComponentReader::methodOpen( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    EXTfldval pathVal;
+    
+    // Parameter 1: Path of ICS file
+    if ( getParamVar(pThreadData, 1, pathVal) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, path, is unrecognized.  Expected file path.";
+        return ERR_BAD_PARAMS;
+	}
+    if( ensurePosixPath(pathVal) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, path, is unrecognized.  Expected file path.";
+        return ERR_BAD_PARAMS;
+    }
+    std::string pathString = getStringFromEXTFldVal(pathVal);
+    
+    // Discard anything from a previous file
+    close();
+    
+    // Open the file for reading
+    state->stream = shared_ptr<FILE>(fopen(pathString.c_str(),"r"), fclose);
+    if (!state->stream) {
+        pThreadData->mExtraErrorText = str(format("Unable to open file \"%s\"") % pathString);
+        return ERR_METHOD_FAILED;
+    }
+    
+    // Create a new parser object and tell it what input routine to use.
+    state->parser = shared_ptr<icalparser>(icalparser_new(), icalparser_free);
+    icalparser_set_gen_data(state->parser.get(),state->stream.get());
+    
+    return METHOD_DONE_RETURN;
+}
+
+// This method returns the next top-level component in the file (Empty once the end of the file is reached)
+tResult NVObjComponentReader::methodNextComponent( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    if (!state->stream || !state->parser) {
+        pThreadData->mExtraErrorText = "Reader not open.  Call $open first.";
+        return ERR_METHOD_FAILED;
+    }
+    
+    EXTfldval retVal;
+    icalcomponent_kind filterType = ICAL_ANY_COMPONENT;
+    ConstantLookup<icalcomponent_kind> compTypeLookup;
+    
+    // Param 1: (Optional) Set the type of component to read
+    EXTfldval filterVal;
+    int filterInt;
+    if ( getParamVar(pThreadData, 1, filterVal) == qtrue ) {
+        filterInt = getIntFromEXTFldVal(filterVal, compTypeLookup.first(), compTypeLookup.last());
+        if (filterInt > 0) {
+            filterType = compTypeLookup.get(filterInt);
+        }
+	}
+    
+    // Read the next component.  The Component object owns it, so it's freed as soon as the caller is done with it.
+    icalcomponent* next = readComponent(filterType);
+    if (next) {
+        NVObjComponent* newComp = createNVObj<NVObjComponent>(pThreadData);
+        if (!newComp) {
+            icalcomponent_free(next);
+            return ERR_METHOD_FAILED;
+        }
+        newComp->setComponent(next);
+        getEXTFldValForObj<NVObjComponent>(retVal, newComp);
+        state->componentsRead++;
+    }
+    
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
+
+// This method closes the file
+tResult NVObjComponentReader::methodClose( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    close();
+    
+    return METHOD_DONE_RETURN;
+}
\ No newline at end of file
@@ -774,3 +774,36 @@ void LibiCalConstants::getLookup<icalrecurrencetype_weekday>(map<int, icalrecurr
     lookup[7] = ICAL_FRIDAY_WEEKDAY;
     lookup[8] = ICAL_SATURDAY_WEEKDAY;
 }
+
+
+/********************************************************************
+ *                             LOAD MODE                            *
+ ********************************************************************/
+
+// Build the lookups for load mode
+template<>
+void LibiCalConstants::getLookup<LibiCalConstants::LoadMode>(map<int, LibiCalConstants::LoadMode>& lookup, LibiCalConstants::LoadMode& def, int& start, int& offset) {
+    start = 23700;
+    def = LOAD_STANDARD;
+    
+    lookup[1] = LOAD_STANDARD;
+    lookup[2] = LOAD_MAPPED;
+    lookup[3] = LOAD_PARALLEL;
+    lookup[4] = LOAD_LAZY;
+}
+
+
+/********************************************************************
+ *                          EXPAND COLUMNS                          *
+ ********************************************************************/
+
+// Build the lookups for expand columns
+template<>
+void LibiCalConstants::getLookup<LibiCalConstants::ExpandColumns>(map<int, LibiCalConstants::ExpandColumns>& lookup, LibiCalConstants::ExpandColumns& def, int& start, int& offset) {
+    start = 23800;
+    def = EXPAND_DATETIME;
+    
+    lookup[1] = EXPAND_DATETIME;
+    lookup[2] = EXPAND_EPOCH;
+    lookup[3] = EXPAND_DATETIME_EPOCH;
+}
\ No newline at end of file
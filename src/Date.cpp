@@ -27,6 +27,9 @@
 
 #include "TimeZone.he"
 #include "SystemDate.h"
+#include "ZoneCache.he"
+#include "ZoneDatabase.he"
+#include "ZoneTransitions.he"
 
 #include <ctime>
 #include <boost/format.hpp>
@@ -163,7 +166,8 @@ const static qshort cDatePropertyYear         = 6400,
                     cDatePropertyIsDaylight   = 6408,
                     cDatePropertyTimezone     = 6409,
                     cDatePropertyTimezoneDesc = 6410,
-                    cDatePropertyDate         = 6411;
+                    cDatePropertyDate         = 6411,
+                    cDatePropertyAbbreviation = 6412;
 
 // Table of properties available from Simple
 // Columns are:
@@ -187,7 +191,8 @@ ECOproperty cDatePropertyTable[] =
     cDatePropertyIsDaylight,   cDatePropertyIsDaylight,   fftBoolean,   EXTD_FLAG_PROPCUSTOM, 0, 0 ,0,
     cDatePropertyTimezone,     cDatePropertyTimezone,     fftObject,    EXTD_FLAG_PROPCUSTOM, 0, 0 ,0,
     cDatePropertyTimezoneDesc, cDatePropertyTimezoneDesc, fftCharacter, EXTD_FLAG_PROPCUSTOM, 0, 0 ,0,
-    cDatePropertyDate,         cDatePropertyDate,         fftDate,      EXTD_FLAG_PROPCUSTOM, 0, 0 ,0
+    cDatePropertyDate,         cDatePropertyDate,         fftDate,      EXTD_FLAG_PROPCUSTOM, 0, 0 ,0,
+    cDatePropertyAbbreviation, cDatePropertyAbbreviation, fftCharacter, EXTD_FLAG_PROPCUSTOM, 0, 0 ,0
 };
 
 // List of properties in Simple
@@ -202,6 +207,35 @@ qlong NVObjDate::returnProperties( tThreadData* pThreadData )
  **                                  PROPERTY CALL                                               **
  **************************************************************************************************/
 
+// Abbreviation of a time's zone at that time (e.g. "BST"), from the compiled zone database.  Empty for dates, floating 
+// times, zones from a calendar's VTIMEZONE, and times the database doesn't cover.
+static std::string getZoneAbbreviation(const icaltimetype& datetime) {
+    icaltimezone* zone = const_cast<icaltimezone*>(icaltime_get_timezone(datetime));
+    if (datetime.is_date == 1)
+        return std::string();
+    if (icaltime_is_utc(datetime) || zone == icaltimezone_get_utc_timezone())
+        return "UTC";
+    
+    boost::shared_ptr<ZoneDatabase> database = ZoneDatabase::shared();
+    if (!zone || !database)
+        return std::string();
+    
+    // A calendar's VTIMEZONE can have the location of a built-in zone without its rules
+    const ZoneDatabaseZone* databaseZone = 0;
+    {
+        boost::recursive_mutex::scoped_lock libical(ZoneCache::libicalLock());
+        const char* location = icaltimezone_get_location(zone);
+        if (location && icaltimezone_get_builtin_timezone(location) == zone)
+            databaseZone = database->findZone(location);
+    }
+    
+    ZoneOffset offset;
+    ZoneTransitions transitions(zone);
+    if (!databaseZone || !database->getOffset(databaseZone, transitions.asTimet(datetime), offset))
+        return std::string();
+    return offset.abbreviation;
+}
+
 // Assignability of properties
 qlong NVObjDate::canAssignProperty( tThreadData* pThreadData, qlong propID ) {
 	switch (propID) {
@@ -218,6 +252,7 @@ qlong NVObjDate::canAssignProperty( tThreadData* pThreadData, qlong propID ) {
         case cDatePropertyIsDate:
         case cDatePropertyIsDaylight:
         case cDatePropertyTimezoneDesc:
+        case cDatePropertyAbbreviation:
 			return qfalse;
 		default:
 			return qfalse;
@@ -283,6 +318,9 @@ qlong NVObjDate::getProperty( tThreadData* pThreadData )
         case cDatePropertyDate:
             getEXTFldValFromTimeType(fValReturn, datetime);
             break;
+        case cDatePropertyAbbreviation:
+            getEXTFldValFromString(fValReturn, getZoneAbbreviation(datetime));
+            break;
     }
 
     ECOaddParam(pThreadData->mEci, &fValReturn); // Return to caller
@@ -365,7 +403,7 @@ void NVObjDate::setCurrentTimeZone(icaltimetype& datetime) {
         icalZone = icaltimezone_get_builtin_timezone(location.c_str());
         
         // Convert to current time zone
-        datetime = icaltime_convert_to_zone(datetime, icalZone);
+        datetime = iCalTools::convertTimeToZone(datetime, icalZone);
     }
 }
 
@@ -508,7 +546,7 @@ tResult NVObjDate::methodConvertTo( tThreadData* pThreadData, qshort pParamCount
     }
     
     // Convert time zone
-    datetime = icaltime_convert_to_zone(datetime, timezoneAssign);
+    datetime = iCalTools::convertTimeToZone(datetime, timezoneAssign);
     
     return METHOD_DONE_RETURN;
 }
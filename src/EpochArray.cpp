@@ -0,0 +1,88 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "EpochArray.he"
+
+using namespace iCalTools;
+
+void iCalTools::intersectEpochs(const EpochArray& a, const EpochArray& b, std::size_t stride, EpochArray& result) {
+    result.clear();
+    
+    std::size_t i = 0, j = 0;
+    while (i + stride <= a.size() && j + stride <= b.size()) {
+        if (a[i] < b[j]) {
+            i += stride;
+        } else if (b[j] < a[i]) {
+            j += stride;
+        } else {
+            result.insert(result.end(), a.begin() + i, a.begin() + i + stride);
+            i += stride;
+            j += stride;
+        }
+    }
+}
+
+void iCalTools::unionEpochs(const EpochArray& a, const EpochArray& b, std::size_t stride, EpochArray& result) {
+    result.clear();
+    result.reserve(a.size() + b.size());
+    
+    std::size_t i = 0, j = 0;
+    while (i + stride <= a.size() || j + stride <= b.size()) {
+        if (j + stride > b.size() || (i + stride <= a.size() && a[i] < b[j])) {
+            result.insert(result.end(), a.begin() + i, a.begin() + i + stride);
+            i += stride;
+        } else if (i + stride > a.size() || b[j] < a[i]) {
+            result.insert(result.end(), b.begin() + j, b.begin() + j + stride);
+            j += stride;
+        } else {
+            result.insert(result.end(), a.begin() + i, a.begin() + i + stride);
+            i += stride;
+            j += stride;
+        }
+    }
+}
+
+std::size_t iCalTools::countEpochs(const EpochArray& a, std::size_t stride, tEpoch from, tEpoch to) {
+    // Sorted, so find the ends of the range by bisection
+    std::size_t elements = a.size() / stride;
+    std::size_t low = 0, high = elements;
+    while (low < high) {
+        std::size_t middle = low + (high - low) / 2;
+        if (a[middle * stride] < from) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    std::size_t first = low;
+    
+    high = elements;
+    while (low < high) {
+        std::size_t middle = low + (high - low) / 2;
+        if (a[middle * stride] < to) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low - first;
+}
\ No newline at end of file
@@ -0,0 +1,336 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Expansion.he"
+#include "ExpansionCache.he"
+#include "ICSWriter.he"
+#include "RecurrenceIterator.he"
+#include "ZoneTransitions.he"
+
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+
+using namespace iCalTools;
+
+// What expansion needs from a component, gathered in one pass over its properties
+struct ExpansionSource {
+    icalcomponent* comp;
+    const char* uid;
+    
+    icaltimetype dtstart;
+    icaltimezone* zone;
+    time_t start;
+    time_t duration;
+    
+    std::vector<icalproperty*> rrules;
+    std::vector<icalproperty*> rdates;
+    std::vector<icalproperty*> exdates;
+    
+    bool isOverride;
+    time_t recurrenceId;
+    
+    ExpansionSource() : comp(0), uid(0), zone(0), start(0), duration(0), isOverride(false), recurrenceId(0) { }
+};
+
+// A start and end time
+typedef std::pair<time_t, time_t> ExpansionSpan;
+
+// Converters for the zones an expansion meets, so each zone's table is looked up (Or built) once
+typedef std::map< icaltimezone*, boost::shared_ptr<ZoneTransitions> > ExpansionZones;
+
+static ZoneTransitions& getTransitions(ExpansionZones& zones, icaltimezone* zone) {
+    boost::shared_ptr<ZoneTransitions>& transitions = zones[zone];
+    if (!transitions) {
+        transitions = boost::shared_ptr<ZoneTransitions>(new ZoneTransitions(zone));
+    }
+    return *transitions;
+}
+
+// The zone for a time in a property: UTC, the TZID parameter (Looked up in the calendar first, then the built in zones) 
+// or the floating zone
+static icaltimezone* getPropertyZone(icalproperty* prop, const icaltimetype& tt, icalcomponent* calendar, icaltimezone* floatingZone) {
+    if (tt.is_utc)
+        return icaltimezone_get_utc_timezone();
+    if (tt.zone)
+        return const_cast<icaltimezone*>(tt.zone);
+    
+    icalparameter* tzidParam = icalproperty_get_first_parameter(prop, ICAL_TZID_PARAMETER);
+    const char* tzid = (tzidParam ? icalparameter_get_tzid(tzidParam) : 0);
+    if (tzid) {
+        icaltimezone* zone = (calendar ? icalcomponent_get_timezone(calendar, tzid) : 0);
+        if (!zone)
+            zone = icaltimezone_get_builtin_timezone_from_tzid(tzid);
+        if (!zone)
+            zone = icaltimezone_get_builtin_timezone(tzid);
+        if (zone)
+            return zone;
+    }
+    
+    return floatingZone;
+}
+
+static time_t getPropertyTime(icalproperty* prop, const icaltimetype& tt, icalcomponent* calendar, icaltimezone* floatingZone, ExpansionZones& zones) {
+    return getTransitions(zones, getPropertyZone(prop, tt, calendar, floatingZone)).asTimet(tt);
+}
+
+// Does [start, end) overlap [from, to)?  Instances with no length count if they start inside the window.
+static bool overlaps(time_t start, time_t end, time_t from, time_t to) {
+    if (start >= to)
+        return false;
+    return (end > from || (end == start && start >= from));
+}
+
+// Returns false if the component has no DTSTART
+static bool readSource(icalcomponent* comp, icalcomponent* calendar, icaltimezone* floatingZone, ExpansionZones& zones, ExpansionSource& source) {
+    icalproperty *dtstartProp = 0, *dtendProp = 0, *durationProp = 0, *recurrenceIdProp = 0;
+    
+    std::vector<icalproperty*> props;
+    getProperties(comp, props);
+    for (std::vector<icalproperty*>::iterator it = props.begin(); it != props.end(); ++it) {
+        switch (icalproperty_isa(*it)) {
+            case ICAL_DTSTART_PROPERTY:      dtstartProp = *it; break;
+            case ICAL_DTEND_PROPERTY:
+            case ICAL_DUE_PROPERTY:          dtendProp = *it; break;
+            case ICAL_DURATION_PROPERTY:     durationProp = *it; break;
+            case ICAL_RECURRENCEID_PROPERTY: recurrenceIdProp = *it; break;
+            case ICAL_RRULE_PROPERTY:        source.rrules.push_back(*it); break;
+            case ICAL_RDATE_PROPERTY:        source.rdates.push_back(*it); break;
+            case ICAL_EXDATE_PROPERTY:       source.exdates.push_back(*it); break;
+            case ICAL_UID_PROPERTY:          source.uid = icalproperty_get_uid(*it); break;
+            default: break;
+        }
+    }
+    
+    if (!dtstartProp)
+        return false;
+    source.dtstart = icalproperty_get_dtstart(dtstartProp);
+    if (icaltime_is_null_time(source.dtstart))
+        return false;
+    
+    source.comp = comp;
+    source.zone = getPropertyZone(dtstartProp, source.dtstart, calendar, floatingZone);
+    source.start = getTransitions(zones, source.zone).asTimet(source.dtstart);
+    
+    // Length from DTEND (or DUE), then DURATION.  All day events without either last a day.
+    if (dtendProp) {
+        icaltimetype dtend = (icalproperty_isa(dtendProp) == ICAL_DUE_PROPERTY ? icalproperty_get_due(dtendProp) : icalproperty_get_dtend(dtendProp));
+        source.duration = getPropertyTime(dtendProp, dtend, calendar, floatingZone, zones) - source.start;
+    } else if (durationProp) {
+        source.duration = icaldurationtype_as_int(icalproperty_get_duration(durationProp));
+    } else {
+        source.duration = (source.dtstart.is_date ? 86400 : 0);
+    }
+    if (source.duration < 0)
+        source.duration = 0;
+    
+    if (recurrenceIdProp) {
+        icaltimetype recurrenceId = icalproperty_get_recurrenceid(recurrenceIdProp);
+        source.isOverride = true;
+        source.recurrenceId = getPropertyTime(recurrenceIdProp, recurrenceId, calendar, floatingZone, zones);
+    }
+    
+    return true;
+}
+
+// Local date of a time as YYYYMMDD, for matching DATE exceptions against DATE-TIME instances
+static int localDay(time_t t, ZoneTransitions& zone) {
+    icaltimetype tt = zone.fromTimet(t, 0);
+    return tt.year * 10000 + tt.month * 100 + tt.day;
+}
+
+// Expand one event that isn't an override.  overridden holds the RECURRENCE-IDs of its overrides.
+static void expandSource(const ExpansionSource& source, icalcomponent* calendar, icaltimezone* floatingZone, ExpansionZones& zones, 
+                         const std::set<time_t>& overridden, time_t from, time_t to, std::vector<ExpandedInstance>& instances) 
+{
+    std::vector<ExpansionSpan> spans;
+    ZoneTransitions& sourceZone = getTransitions(zones, source.zone);
+    
+    // DTSTART is always the first instance
+    if (overlaps(source.start, source.start + source.duration, from, to))
+        spans.push_back(ExpansionSpan(source.start, source.start + source.duration));
+    
+    // RRULE instances.  Starts that could overlap the window are cached by rule, DTSTART and zone, so refreshing an 
+    // overlapping window doesn't iterate again.  Simple rules seek close to the window rather than stepping from DTSTART.  The seek allows 
+    // a day for a change of UTC offset, and DTSTART was added above.
+    time_t windowStart = from - source.duration;
+    icaltimetype seekTo = sourceZone.fromTimet(windowStart - 86400, source.dtstart.is_date);
+    ExpansionCache::Starts starts;
+    for (std::vector<icalproperty*>::const_iterator it = source.rrules.begin(); it != source.rrules.end(); ++it) {
+        icalrecurrencetype rule = icalproperty_get_rrule(*it);
+        std::string cacheKey;
+        bool cached = getExpansionCacheKey(rule, source.dtstart, source.zone, cacheKey);
+        
+        if (!cached || !ExpansionCache::instance().find(cacheKey, windowStart, to, starts)) {
+            RecurrenceIterator recurIt(rule, source.dtstart, seekTo);
+            if (!recurIt.isValid())
+                continue;
+            
+            // In order, so stop at the end of the window
+            starts.clear();
+            for (icaltimetype next = recurIt.next(); !icaltime_is_null_time(next); next = recurIt.next()) {
+                time_t start = sourceZone.asTimet(next);
+                if (start >= to)
+                    break;
+                if (start >= windowStart)
+                    starts.push_back(start);
+            }
+            if (cached)
+                ExpansionCache::instance().store(cacheKey, windowStart, to, starts);
+        }
+        
+        for (ExpansionCache::Starts::const_iterator start = starts.begin(); start != starts.end(); ++start) {
+            if (overlaps(*start, *start + source.duration, from, to))
+                spans.push_back(ExpansionSpan(*start, *start + source.duration));
+        }
+    }
+    
+    // RDATE instances.  Periods carry their own length.
+    for (std::vector<icalproperty*>::const_iterator it = source.rdates.begin(); it != source.rdates.end(); ++it) {
+        icaldatetimeperiodtype rdate = icalproperty_get_rdate(*it);
+        time_t start, end;
+        if (!icalperiodtype_is_null_period(rdate.period)) {
+            start = getPropertyTime(*it, rdate.period.start, calendar, floatingZone, zones);
+            if (icaltime_is_null_time(rdate.period.end)) {
+                end = start + icaldurationtype_as_int(rdate.period.duration);
+            } else {
+                end = getPropertyTime(*it, rdate.period.end, calendar, floatingZone, zones);
+            }
+        } else {
+            start = getPropertyTime(*it, rdate.time, calendar, floatingZone, zones);
+            end = start + source.duration;
+        }
+        if (overlaps(start, end, from, to))
+            spans.push_back(ExpansionSpan(start, end));
+    }
+    
+    if (spans.empty())
+        return;
+    
+    // EXDATE instances.  A DATE removes every instance on that day.
+    std::set<time_t> excludedTimes;
+    std::set<int> excludedDays;
+    for (std::vector<icalproperty*>::const_iterator it = source.exdates.begin(); it != source.exdates.end(); ++it) {
+        icaltimetype exdate = icalproperty_get_exdate(*it);
+        if (exdate.is_date && !source.dtstart.is_date) {
+            excludedDays.insert(exdate.year * 10000 + exdate.month * 100 + exdate.day);
+        } else {
+            excludedTimes.insert(getPropertyTime(*it, exdate, calendar, floatingZone, zones));
+        }
+    }
+    
+    std::sort(spans.begin(), spans.end());
+    
+    bool recurring = (!source.rrules.empty() || !source.rdates.empty());
+    time_t last = 0;
+    for (std::vector<ExpansionSpan>::iterator it = spans.begin(); it != spans.end(); ++it) {
+        // DTSTART is usually also the first RRULE instance
+        if (it != spans.begin() && it->first == last)
+            continue;
+        last = it->first;
+        
+        if (excludedTimes.count(it->first) || overridden.count(it->first))
+            continue;
+        if (!excludedDays.empty() && excludedDays.count(localDay(it->first, sourceZone)))
+            continue;
+        
+        ExpandedInstance instance;
+        instance.uid = source.uid;
+        instance.start = it->first;
+        instance.end = it->second;
+        instance.recurrenceId = it->first;
+        instance.hasRecurrenceId = recurring;
+        instance.isDate = (source.dtstart.is_date != 0);
+        instance.isOverride = false;
+        instances.push_back(instance);
+    }
+}
+
+static bool instanceBefore(const ExpandedInstance& a, const ExpandedInstance& b) {
+    if (a.start != b.start)
+        return a.start < b.start;
+    return strcmp(a.uid ? a.uid : "", b.uid ? b.uid : "") < 0;
+}
+
+void iCalTools::expandInstances(icalcomponent* root, time_t from, time_t to, icaltimezone* floatingZone, std::vector<ExpandedInstance>& instances) {
+    if (!root)
+        return;
+    
+    // Events to expand, and the calendar their TZIDs refer to
+    std::vector<icalcomponent*> events;
+    icalcomponent* calendar = root;
+    icalcomponent_kind rootKind = icalcomponent_isa(root);
+    if (rootKind == ICAL_VEVENT_COMPONENT || rootKind == ICAL_VTODO_COMPONENT || rootKind == ICAL_VJOURNAL_COMPONENT) {
+        events.push_back(root);
+        calendar = icalcomponent_get_parent(root);
+    } else {
+        icalcompiter itr = icalcomponent_begin_component(root, ICAL_ANY_COMPONENT);
+        for (icalcomponent* child = icalcompiter_deref(&itr); child != 0; child = icalcompiter_next(&itr)) {
+            icalcomponent_kind kind = icalcomponent_isa(child);
+            if (kind == ICAL_VEVENT_COMPONENT || kind == ICAL_VTODO_COMPONENT || kind == ICAL_VJOURNAL_COMPONENT)
+                events.push_back(child);
+        }
+    }
+    if (calendar && icalcomponent_isa(calendar) != ICAL_VCALENDAR_COMPONENT)
+        calendar = 0;
+    
+    ExpansionZones zones;
+    std::vector<ExpansionSource> sources;
+    sources.reserve(events.size());
+    std::map<std::string, std::set<time_t> > overriddenByUID;
+    for (std::vector<icalcomponent*>::iterator it = events.begin(); it != events.end(); ++it) {
+        ExpansionSource source;
+        if (!readSource(*it, calendar, floatingZone, zones, source))
+            continue;
+        
+        // Overrides are instances in their own right, wherever they've been moved to
+        if (source.isOverride) {
+            overriddenByUID[source.uid ? source.uid : ""].insert(source.recurrenceId);
+            if (overlaps(source.start, source.start + source.duration, from, to)) {
+                ExpandedInstance instance;
+                instance.uid = source.uid;
+                instance.start = source.start;
+                instance.end = source.start + source.duration;
+                instance.recurrenceId = source.recurrenceId;
+                instance.hasRecurrenceId = true;
+                instance.isDate = (source.dtstart.is_date != 0);
+                instance.isOverride = true;
+                instances.push_back(instance);
+            }
+            continue;
+        }
+        
+        sources.push_back(source);
+    }
+    
+    const std::set<time_t> noOverrides;
+    for (std::vector<ExpansionSource>::iterator source = sources.begin(); source != sources.end(); ++source) {
+        std::map<std::string, std::set<time_t> >::iterator overridden = overriddenByUID.find(source->uid ? source->uid : "");
+        expandSource(*source, calendar, floatingZone, zones, (overridden != overriddenByUID.end() ? overridden->second : noOverrides), from, to, instances);
+    }
+    
+    std::stable_sort(instances.begin(), instances.end(), instanceBefore);
+}
\ No newline at end of file
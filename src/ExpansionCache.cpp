@@ -0,0 +1,196 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "ExpansionCache.he"
+#include "ZoneCache.he"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace iCalTools;
+
+// Most occurrence starts held at once (8 bytes each)
+const static std::size_t kMaxCachedOccurrences = 2000000;
+
+ExpansionCache::ExpansionCache() : occurrences(0), hits(0), misses(0), evictions(0) 
+{ }
+
+// Constructed when the library loads, before any thread can use it
+ExpansionCache ExpansionCache::sharedCache;
+
+ExpansionCache& ExpansionCache::instance() {
+    return sharedCache;
+}
+
+bool ExpansionCache::find(const std::string& key, time_t from, time_t to, Starts& starts) {
+    boost::mutex::scoped_lock guard(lock);
+    
+    EntryMap::iterator it = entries.find(key);
+    if (it == entries.end() || from < it->second.from || to > it->second.to) {
+        ++misses;
+        return false;
+    }
+    ++hits;
+    
+    // Most recently used
+    lru.splice(lru.begin(), lru, it->second.lruPos);
+    
+    const Starts& cached = it->second.starts;
+    Starts::const_iterator first = std::lower_bound(cached.begin(), cached.end(), from);
+    Starts::const_iterator last = std::lower_bound(first, cached.end(), to);
+    starts.assign(first, last);
+    return true;
+}
+
+void ExpansionCache::store(const std::string& key, time_t from, time_t to, const Starts& starts) {
+    if (starts.size() > kMaxCachedOccurrences)
+        return;
+    
+    boost::mutex::scoped_lock guard(lock);
+    
+    EntryMap::iterator it = entries.find(key);
+    if (it == entries.end()) {
+        lru.push_front(key);
+        Entry& entry = entries[key];
+        entry.from = from;
+        entry.to = to;
+        entry.starts = starts;
+        entry.lruPos = lru.begin();
+        occurrences += starts.size();
+    } else {
+        Entry& entry = it->second;
+        occurrences -= entry.starts.size();
+        
+        if (from <= entry.to && to >= entry.from) {
+            // Both windows hold every start in them, so their union holds every start in the combined window
+            Starts merged;
+            merged.reserve(entry.starts.size() + starts.size());
+            std::set_union(entry.starts.begin(), entry.starts.end(), starts.begin(), starts.end(), std::back_inserter(merged));
+            entry.starts.swap(merged);
+            entry.from = (from < entry.from ? from : entry.from);
+            entry.to = (to > entry.to ? to : entry.to);
+        } else {
+            // Apart from the cached window, so the new one replaces it
+            entry.from = from;
+            entry.to = to;
+            entry.starts = starts;
+        }
+        occurrences += entry.starts.size();
+        lru.splice(lru.begin(), lru, entry.lruPos);
+    }
+    
+    evict();
+}
+
+// Drops the least recently used entries until the cache is within its size.  Called with the lock held.
+void ExpansionCache::evict() {
+    while (occurrences > kMaxCachedOccurrences && !lru.empty()) {
+        EntryMap::iterator it = entries.find(lru.back());
+        occurrences -= it->second.starts.size();
+        entries.erase(it);
+        lru.pop_back();
+        ++evictions;
+    }
+}
+
+ExpansionCacheStats ExpansionCache::stats() {
+    boost::mutex::scoped_lock guard(lock);
+    
+    ExpansionCacheStats result;
+    result.hits = hits;
+    result.misses = misses;
+    result.evictions = evictions;
+    result.entries = entries.size();
+    result.occurrences = occurrences;
+    return result;
+}
+
+void ExpansionCache::clear() {
+    boost::mutex::scoped_lock guard(lock);
+    
+    entries.clear();
+    lru.clear();
+    occurrences = 0;
+    hits = misses = evictions = 0;
+}
+
+// Append a calendar zone's TZID and the text of its observances (STANDARD/DAYLIGHT), which define its offsets.  Called with the 
+// libical lock held.
+static bool appendCalendarZoneKey(icaltimezone* zone, std::string& key) {
+    icalcomponent* vtimezone = icaltimezone_get_component(zone);
+    const char* tzid = icaltimezone_get_tzid(zone);
+    if (!vtimezone || !tzid)
+        return false;
+    
+    key += tzid;
+    for (icalcomponent* observance = icalcomponent_get_first_component(vtimezone, ICAL_ANY_COMPONENT); observance; 
+         observance = icalcomponent_get_next_component(vtimezone, ICAL_ANY_COMPONENT)) 
+    {
+        icalcomponent_kind kind = icalcomponent_isa(observance);
+        if (kind != ICAL_XSTANDARD_COMPONENT && kind != ICAL_XDAYLIGHT_COMPONENT)
+            continue;
+        
+        char* observanceText = icalcomponent_as_ical_string_r(observance);
+        if (observanceText) {
+            key += observanceText;
+            icalmemory_free_buffer(observanceText);
+        }
+    }
+    return true;
+}
+
+bool iCalTools::getExpansionCacheKey(const icalrecurrencetype& rule, const icaltimetype& dtstart, icaltimezone* zone, std::string& key) {
+    // icalrecurrencetype_as_string_r takes a non-const rule
+    icalrecurrencetype keyRule = rule;
+    
+    key.clear();
+    char* ruleText = icalrecurrencetype_as_string_r(&keyRule);
+    if (ruleText) {
+        key += ruleText;
+        icalmemory_free_buffer(ruleText);
+    }
+    key += '|';
+    char* startText = icaltime_as_ical_string_r(dtstart);
+    if (startText) {
+        key += startText;
+        icalmemory_free_buffer(startText);
+    }
+    key += '|';
+    
+    if (!zone)
+        return true;
+    if (zone == icaltimezone_get_utc_timezone()) {
+        key += "UTC";
+        return true;
+    }
+    
+    // Built-in zones are identified by location, which only names one definition.  A calendar's VTIMEZONE is identified by its 
+    // definition, since two calendars can give the same TZID different rules.
+    boost::recursive_mutex::scoped_lock libical(ZoneCache::libicalLock());
+    const char* location = icaltimezone_get_location(zone);
+    if (location && icaltimezone_get_builtin_timezone(location) == zone) {
+        key += location;
+        return true;
+    }
+    key += "VTIMEZONE:";
+    return appendCalendarZoneKey(zone, key);
+}
\ No newline at end of file
@@ -0,0 +1,297 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "ICSWriter.he"
+
+#include <cstring>
+#include <string>
+
+using namespace iCalTools;
+
+// RFC 5545 3.1: Lines shouldn't be longer than 75 octets, excluding the line break
+const static std::size_t kMaxLineOctets = 75;
+
+ICSWriter::ICSWriter(std::size_t bufferSize) : buffer(bufferSize), used(0), error(false) { }
+
+ICSWriter::~ICSWriter() { }
+
+void ICSWriter::append(const char* data, std::size_t length) {
+    // Unbuffered
+    if (buffer.empty()) {
+        if (!error && length > 0 && !writeBytes(data, length))
+            error = true;
+        return;
+    }
+    
+    while (length > 0) {
+        if (used == buffer.size()) {
+            flush();
+        }
+        
+        std::size_t space = buffer.size() - used;
+        std::size_t count = (length < space ? length : space);
+        memcpy(&buffer[used], data, count);
+        used += count;
+        data += count;
+        length -= count;
+    }
+}
+
+bool ICSWriter::flush() {
+    if (used > 0) {
+        if (!error && !writeBytes(&buffer[0], used))
+            error = true;
+        used = 0;
+    }
+    
+    return !error;
+}
+
+void ICSWriter::writeContentLine(const char* line, std::size_t length) {
+    std::size_t pos = 0;
+    bool firstLine = true;
+    
+    do {
+        // Continuation lines lose an octet to the leading space
+        std::size_t limit = (firstLine ? kMaxLineOctets : kMaxLineOctets - 1);
+        std::size_t count = length - pos;
+        if (count > limit) {
+            count = limit;
+            // Back up to the start of a UTF-8 sequence
+            while (count > 1 && (static_cast<unsigned char>(line[pos + count]) & 0xC0) == 0x80)
+                count--;
+        }
+        
+        if (!firstLine)
+            append(" ", 1);
+        append(line + pos, count);
+        append("\r\n", 2);
+        
+        pos += count;
+        firstLine = false;
+    } while (pos < length);
+}
+
+// Escape used by libical for a character in a TEXT value (0 for characters that are written as-is)
+static inline char textEscape(char c) {
+    switch (c) {
+        case '\b': return 'b';
+        case '\t': return 't';
+        case '\n': return 'n';
+        case '\f': return 'f';
+        case '\r': return 'r';
+        case '"':
+        case '\\':
+        case ';':
+        case ',':
+            return c;
+        default:
+            return 0;
+    }
+}
+
+// Append a TEXT value with backslash escapes.  Runs of characters that don't need escaping are copied in one go.
+// Separators (';' and ',') are left alone in CATEGORIES, where they delimit the list.
+void ICSWriter::appendEscapedText(const char* text, bool escapeSeparators) {
+    const char* runStart = text;
+    const char* pos = text;
+    
+    for (; *pos; ++pos) {
+        char escape = textEscape(*pos);
+        if (!escape || (!escapeSeparators && (escape == ';' || escape == ',')))
+            continue;
+        
+        propertyLine.append(runStart, pos - runStart);
+        propertyLine.push_back('\\');
+        propertyLine.push_back(escape);
+        runStart = pos + 1;
+    }
+    propertyLine.append(runStart, pos - runStart);
+}
+
+// Build a property's content line.  This follows icalproperty_as_ical_string, but TEXT values are escaped here rather
+// than through libical's temporary buffers, and libical's own folding is skipped since the line is folded on output.
+void ICSWriter::writeProperty(icalproperty* prop) {
+    icalproperty_kind kind = icalproperty_isa(prop);
+    
+    // Name
+    const char* name = 0;
+    if (kind == ICAL_X_PROPERTY)
+        name = icalproperty_get_x_name(prop);
+    if (!name)
+        name = icalproperty_kind_to_string(kind);
+    if (!name)
+        return;
+    
+    propertyLine.assign(name);
+    
+    // VALUE parameter: Kept if the property had one, otherwise only written when the value isn't the default type
+    icalvalue* value = icalproperty_get_value(prop);
+    icalparameter* valueParam = icalproperty_get_first_parameter(prop, ICAL_VALUE_PARAMETER);
+    icalvalue_kind paramKind = (valueParam ? icalparameter_value_to_value_kind(icalparameter_get_value(valueParam)) : ICAL_NO_VALUE);
+    icalvalue_kind valueKind = (value ? icalvalue_isa(value) : ICAL_NO_VALUE);
+    
+    const char* valueKindString = 0;
+    if (paramKind != ICAL_NO_VALUE) {
+        valueKindString = icalvalue_kind_to_string(paramKind);
+    } else if (valueKind != icalproperty_kind_to_value_kind(kind) && valueKind != ICAL_NO_VALUE) {
+        valueKindString = icalvalue_kind_to_string(valueKind);
+    }
+    if (valueKindString) {
+        propertyLine.append(";VALUE=");
+        propertyLine.append(valueKindString);
+    }
+    
+    // Other parameters
+    for (icalparameter* param = icalproperty_get_first_parameter(prop, ICAL_ANY_PARAMETER); param != 0; param = icalproperty_get_next_parameter(prop, ICAL_ANY_PARAMETER)) {
+        if (icalparameter_isa(param) == ICAL_VALUE_PARAMETER)
+            continue;
+        
+        char* paramString = icalparameter_as_ical_string_r(param);
+        if (paramString) {
+            propertyLine.push_back(';');
+            propertyLine.append(paramString);
+            icalmemory_free_buffer(paramString);
+        }
+    }
+    
+    // Value
+    propertyLine.push_back(':');
+    if (valueKind == ICAL_TEXT_VALUE) {
+        const char* text = icalvalue_get_text(value);
+        appendEscapedText((text ? text : ""), kind != ICAL_CATEGORIES_PROPERTY);
+    } else {
+        char* valueString = (value ? icalvalue_as_ical_string_r(value) : 0);
+        if (valueString) {
+            propertyLine.append(valueString);
+            icalmemory_free_buffer(valueString);
+        } else {
+            propertyLine.append("ERROR: No Value");
+        }
+    }
+    
+    writeContentLine(propertyLine.data(), propertyLine.size());
+}
+
+void iCalTools::getProperties(icalcomponent* comp, std::vector<icalproperty*>& props) {
+    props.clear();
+    
+    icalproperty* current = icalcomponent_get_current_property(comp);
+    for (icalproperty* prop = icalcomponent_get_first_property(comp, ICAL_ANY_PROPERTY); prop != 0; prop = icalcomponent_get_next_property(comp, ICAL_ANY_PROPERTY)) {
+        props.push_back(prop);
+    }
+    if (current) {
+        icalproperty* prop = icalcomponent_get_first_property(comp, ICAL_ANY_PROPERTY);
+        while (prop != 0 && prop != current)
+            prop = icalcomponent_get_next_property(comp, ICAL_ANY_PROPERTY);
+    }
+}
+
+void ICSWriter::writeBegin(icalcomponent* comp) {
+    const char* name = icalcomponent_kind_to_string(icalcomponent_isa(comp));
+    propertyLine.assign("BEGIN:");
+    propertyLine.append(name ? name : "");
+    writeContentLine(propertyLine.data(), propertyLine.size());
+}
+
+void ICSWriter::writeEnd(icalcomponent* comp) {
+    const char* name = icalcomponent_kind_to_string(icalcomponent_isa(comp));
+    propertyLine.assign("END:");
+    propertyLine.append(name ? name : "");
+    writeContentLine(propertyLine.data(), propertyLine.size());
+}
+
+void ICSWriter::writeComponent(icalcomponent* comp) {
+    if (!comp)
+        return;
+    
+    writeBegin(comp);
+    
+    std::vector<icalproperty*> props;
+    getProperties(comp, props);
+    for (std::vector<icalproperty*>::iterator it = props.begin(); it != props.end(); ++it) {
+        writeProperty(*it);
+    }
+    
+    icalcompiter itr = icalcomponent_begin_component(comp, ICAL_ANY_COMPONENT);
+    for (icalcomponent* child = icalcompiter_deref(&itr); child != 0; child = icalcompiter_next(&itr)) {
+        writeComponent(child);
+    }
+    
+    writeEnd(comp);
+}
+
+bool FileICSWriter::writeBytes(const char* data, std::size_t length) {
+    return (fwrite(data, 1, length, file) == length);
+}
+
+bool BufferICSWriter::writeBytes(const char* data, std::size_t length) {
+    output.insert(output.end(), data, data + length);
+    return true;
+}
+
+ICSOutputCursor::ICSOutputCursor(boost::shared_ptr<icalcomponent> c) : comp(c), writer(pending), started(false) { }
+
+bool ICSOutputCursor::step() {
+    if (!started) {
+        started = true;
+        if (comp) {
+            writer.writeBegin(comp.get());
+            stack.push_back(Frame(comp.get()));
+            getProperties(comp.get(), stack.back().props);
+            return true;
+        }
+    }
+    
+    if (stack.empty())
+        return false;
+    
+    Frame& frame = stack.back();
+    if (frame.nextProp < frame.props.size()) {
+        writer.writeProperty(frame.props[frame.nextProp++]);
+    } else {
+        icalcomponent* child = (frame.nextChild == 0 ? icalcompiter_deref(&frame.children) : icalcompiter_next(&frame.children));
+        frame.nextChild++;
+        
+        if (child) {
+            writer.writeBegin(child);
+            stack.push_back(Frame(child));
+            getProperties(child, stack.back().props);
+        } else {
+            writer.writeEnd(frame.comp);
+            stack.pop_back();
+        }
+    }
+    
+    return true;
+}
+
+bool ICSOutputCursor::nextChunk(std::size_t maxBytes, std::vector<char>& chunk) {
+    // Serialize just enough lines to fill the chunk.  Whatever is left over is kept for the next one.
+    while (pending.size() < maxBytes && step()) { }
+    
+    std::size_t count = (pending.size() < maxBytes ? pending.size() : maxBytes);
+    chunk.assign(pending.begin(), pending.begin() + count);
+    pending.erase(pending.begin(), pending.begin() + count);
+    
+    return (count > 0);
+}
\ No newline at end of file
@@ -0,0 +1,910 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "JCal.he"
+#include "ICSWriter.he"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+
+#include <cstring>
+#include <vector>
+
+using namespace iCalTools;
+using boost::format;
+
+const static int kMaxComponentDepth = 64;
+
+/**************************************************************************************************
+ **                                       OUTPUT                                                 **
+ **************************************************************************************************/
+
+// Append a non-negative number padded with zeros to at least width digits
+static void appendDigits(std::string& out, int value, int width) {
+    char digits[16];
+    int n = 0;
+    unsigned int v = static_cast<unsigned int>(value < 0 ? -value : value);
+    do {
+        digits[n++] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v && n < 16);
+    while (n < width && n < 16) {
+        digits[n++] = '0';
+    }
+    if (value < 0)
+        out += '-';
+    while (n) {
+        out += digits[--n];
+    }
+}
+
+static void appendJSONString(std::string& out, const char* text) {
+    const static char hex[] = "0123456789abcdef";
+    
+    out += '"';
+    if (text) {
+        for (const unsigned char* c = reinterpret_cast<const unsigned char*>(text); *c; ++c) {
+            switch (*c) {
+                case '"':  out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\b': out += "\\b"; break;
+                case '\f': out += "\\f"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (*c < 0x20) {
+                        out += "\\u00";
+                        out += hex[*c >> 4];
+                        out += hex[*c & 0xF];
+                    } else {
+                        out += static_cast<char>(*c);
+                    }
+                    break;
+            }
+        }
+    }
+    out += '"';
+}
+
+// Names are written in lowercase
+static void appendJSONName(std::string& out, const char* name) {
+    std::string lower(name ? name : "");
+    boost::algorithm::to_lower(lower);
+    appendJSONString(out, lower.c_str());
+}
+
+// DATE as YYYY-MM-DD and DATE-TIME as YYYY-MM-DDTHH:MM:SS (With a Z for UTC).  No quotes.
+static void appendJCalTime(std::string& out, const icaltimetype& tt) {
+    appendDigits(out, tt.year, 4);
+    out += '-';
+    appendDigits(out, tt.month, 2);
+    out += '-';
+    appendDigits(out, tt.day, 2);
+    if (!tt.is_date) {
+        out += 'T';
+        appendDigits(out, tt.hour, 2);
+        out += ':';
+        appendDigits(out, tt.minute, 2);
+        out += ':';
+        appendDigits(out, tt.second, 2);
+        if (tt.is_utc)
+            out += 'Z';
+    }
+}
+
+static void appendDuration(std::string& out, const icaldurationtype& duration) {
+    char* durationString = icaldurationtype_as_ical_string_r(duration);
+    if (durationString) {
+        out += durationString;
+        icalmemory_free_buffer(durationString);
+    }
+}
+
+// Quoted start/end or start/duration
+static void appendJCalPeriod(std::string& out, const icalperiodtype& period) {
+    out += '"';
+    appendJCalTime(out, period.start);
+    out += '/';
+    if (icaltime_is_null_time(period.end)) {
+        appendDuration(out, period.duration);
+    } else {
+        appendJCalTime(out, period.end);
+    }
+    out += '"';
+}
+
+static bool isJSONInteger(const std::string& text) {
+    std::size_t start = (!text.empty() && (text[0] == '-' || text[0] == '+')) ? 1 : 0;
+    if (start >= text.size())
+        return false;
+    for (std::size_t i = start; i < text.size(); i++) {
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+    }
+    return true;
+}
+
+// RRULE parts as a JSON object, e.g. {"freq":"WEEKLY","count":5,"byday":["MO","TU"]}.  Parts with more than one value are arrays.
+static void appendJCalRecur(std::string& out, icalrecurrencetype& recur) {
+    char* recurString = icalrecurrencetype_as_string_r(&recur);
+    std::vector<std::string> parts, values;
+    if (recurString) {
+        std::string text(recurString);
+        icalmemory_free_buffer(recurString);
+        boost::algorithm::split(parts, text, boost::algorithm::is_any_of(";"));
+    }
+    
+    out += '{';
+    bool first = true;
+    for (std::vector<std::string>::iterator part = parts.begin(); part != parts.end(); ++part) {
+        std::size_t eq = part->find('=');
+        if (eq == std::string::npos)
+            continue;
+        
+        std::string key = part->substr(0, eq);
+        if (!first)
+            out += ',';
+        first = false;
+        appendJSONName(out, key.c_str());
+        out += ':';
+        
+        if (key == "UNTIL") {
+            out += '"';
+            appendJCalTime(out, recur.until);
+            out += '"';
+            continue;
+        }
+        
+        std::string valueText = part->substr(eq + 1);
+        boost::algorithm::split(values, valueText, boost::algorithm::is_any_of(","));
+        if (values.size() > 1)
+            out += '[';
+        for (std::vector<std::string>::iterator value = values.begin(); value != values.end(); ++value) {
+            if (value != values.begin())
+                out += ',';
+            if (isJSONInteger(*value) && (*value)[0] != '+') {
+                out += *value;
+            } else {
+                appendJSONString(out, value->c_str());
+            }
+        }
+        if (values.size() > 1)
+            out += ']';
+    }
+    out += '}';
+}
+
+// Append the jCal type name and JSON value.  The value kinds follow getValueForType(), each mapped to its JSON form.
+static void appendJCalValue(std::string& out, icalvalue* value) {
+    icalvalue_kind kind = icalvalue_isa(value);
+    
+    icalgeotype geo;
+    icalrecurrencetype recur;
+    icaldatetimeperiodtype dtp;
+    icaltriggertype trigger;
+    icalattach* attach;
+    char* valueString;
+    int offset;
+    
+    switch (kind) {
+        case ICAL_TEXT_VALUE:
+            out += "\"text\",";
+            appendJSONString(out, icalvalue_get_text(value));
+            break;
+        case ICAL_STRING_VALUE:
+            out += "\"text\",";
+            appendJSONString(out, icalvalue_get_string(value));
+            break;
+        case ICAL_QUERY_VALUE:
+            out += "\"text\",";
+            appendJSONString(out, icalvalue_get_query(value));
+            break;
+        case ICAL_X_VALUE:
+            out += "\"unknown\",";
+            appendJSONString(out, icalvalue_get_x(value));
+            break;
+        case ICAL_DATE_VALUE:
+            out += "\"date\",\"";
+            appendJCalTime(out, icalvalue_get_date(value));
+            out += '"';
+            break;
+        case ICAL_DATETIME_VALUE:
+            out += "\"date-time\",\"";
+            appendJCalTime(out, icalvalue_get_datetime(value));
+            out += '"';
+            break;
+        case ICAL_INTEGER_VALUE:
+            out += "\"integer\",";
+            appendDigits(out, icalvalue_get_integer(value), 1);
+            break;
+        case ICAL_FLOAT_VALUE:
+            out += "\"float\",";
+            out += str(format("%.7g") % icalvalue_get_float(value));
+            break;
+        case ICAL_BOOLEAN_VALUE:
+            out += "\"boolean\",";
+            out += (icalvalue_get_boolean(value) ? "true" : "false");
+            break;
+        case ICAL_UTCOFFSET_VALUE:
+            // +HH:MM, or +HH:MM:SS when there are seconds
+            offset = icalvalue_get_utcoffset(value);
+            out += "\"utc-offset\",\"";
+            out += (offset < 0 ? '-' : '+');
+            if (offset < 0)
+                offset = -offset;
+            appendDigits(out, offset / 3600, 2);
+            out += ':';
+            appendDigits(out, (offset / 60) % 60, 2);
+            if (offset % 60) {
+                out += ':';
+                appendDigits(out, offset % 60, 2);
+            }
+            out += '"';
+            break;
+        case ICAL_GEO_VALUE:
+            geo = icalvalue_get_geo(value);
+            out += "\"float\",[";
+            out += str(format("%.15g") % geo.lat);
+            out += ',';
+            out += str(format("%.15g") % geo.lon);
+            out += ']';
+            break;
+        case ICAL_RECUR_VALUE:
+            recur = icalvalue_get_recur(value);
+            out += "\"recur\",";
+            appendJCalRecur(out, recur);
+            break;
+        case ICAL_PERIOD_VALUE:
+            out += "\"period\",";
+            appendJCalPeriod(out, icalvalue_get_period(value));
+            break;
+        case ICAL_DATETIMEPERIOD_VALUE:
+            dtp = icalvalue_get_datetimeperiod(value);
+            if (!icalperiodtype_is_null_period(dtp.period)) {
+                out += "\"period\",";
+                appendJCalPeriod(out, dtp.period);
+            } else {
+                out += (dtp.time.is_date ? "\"date\",\"" : "\"date-time\",\"");
+                appendJCalTime(out, dtp.time);
+                out += '"';
+            }
+            break;
+        case ICAL_TRIGGER_VALUE:
+            trigger = icalvalue_get_trigger(value);
+            if (icaltime_is_null_time(trigger.time)) {
+                out += "\"duration\",\"";
+                appendDuration(out, trigger.duration);
+            } else {
+                out += "\"date-time\",\"";
+                appendJCalTime(out, trigger.time);
+            }
+            out += '"';
+            break;
+        case ICAL_DURATION_VALUE:
+            out += "\"duration\",\"";
+            appendDuration(out, icalvalue_get_duration(value));
+            out += '"';
+            break;
+        case ICAL_CALADDRESS_VALUE:
+            out += "\"cal-address\",";
+            appendJSONString(out, icalvalue_get_caladdress(value));
+            break;
+        case ICAL_URI_VALUE:
+            out += "\"uri\",";
+            appendJSONString(out, icalvalue_get_uri(value));
+            break;
+        case ICAL_ATTACH_VALUE:
+            attach = icalvalue_get_attach(value);
+            if (attach && icalattach_get_is_url(attach)) {
+                out += "\"uri\",";
+                appendJSONString(out, icalattach_get_url(attach));
+                break;
+            }
+            // Inline attachments are written as their base64 text
+            out += "\"binary\",";
+            valueString = icalvalue_as_ical_string_r(value);
+            appendJSONString(out, valueString);
+            if (valueString)
+                icalmemory_free_buffer(valueString);
+            break;
+        case ICAL_BINARY_VALUE:
+            out += "\"binary\",";
+            valueString = icalvalue_as_ical_string_r(value);
+            appendJSONString(out, valueString);
+            if (valueString)
+                icalmemory_free_buffer(valueString);
+            break;
+        default:
+            // Enumerated values (STATUS, CLASS, ACTION, METHOD...) and REQUEST-STATUS are text
+            out += "\"text\",";
+            valueString = icalvalue_as_ical_string_r(value);
+            appendJSONString(out, valueString);
+            if (valueString)
+                icalmemory_free_buffer(valueString);
+            break;
+    }
+}
+
+static void appendJCalProperty(std::string& out, icalproperty* prop) {
+    icalproperty_kind kind = icalproperty_isa(prop);
+    const char* name = (kind == ICAL_X_PROPERTY ? icalproperty_get_x_name(prop) : 0);
+    
+    out += '[';
+    appendJSONName(out, name ? name : icalproperty_kind_to_string(kind));
+    
+    // Parameters, except VALUE (jCal carries the value type separately)
+    out += ",{";
+    bool first = true;
+    for (icalparameter* param = icalproperty_get_first_parameter(prop, ICAL_ANY_PARAMETER); param != 0; param = icalproperty_get_next_parameter(prop, ICAL_ANY_PARAMETER)) {
+        if (icalparameter_isa(param) == ICAL_VALUE_PARAMETER)
+            continue;
+        
+        char* paramString = icalparameter_as_ical_string_r(param);
+        if (!paramString)
+            continue;
+        
+        std::string paramText(paramString);
+        icalmemory_free_buffer(paramString);
+        std::size_t eq = paramText.find('=');
+        if (eq == std::string::npos)
+            continue;
+        
+        std::string paramValue = paramText.substr(eq + 1);
+        if (paramValue.size() >= 2 && paramValue[0] == '"' && paramValue[paramValue.size() - 1] == '"')
+            paramValue = paramValue.substr(1, paramValue.size() - 2);
+        
+        if (!first)
+            out += ',';
+        first = false;
+        appendJSONName(out, paramText.substr(0, eq).c_str());
+        out += ':';
+        appendJSONString(out, paramValue.c_str());
+    }
+    out += "},";
+    
+    icalvalue* value = icalproperty_get_value(prop);
+    if (value) {
+        appendJCalValue(out, value);
+    } else {
+        out += "\"unknown\",\"\"";
+    }
+    out += ']';
+}
+
+void iCalTools::writeJCal(icalcomponent* comp, std::string& out) {
+    if (!comp)
+        return;
+    
+    out += '[';
+    appendJSONName(out, icalcomponent_kind_to_string(icalcomponent_isa(comp)));
+    
+    out += ",[";
+    std::vector<icalproperty*> props;
+    getProperties(comp, props);
+    for (std::vector<icalproperty*>::iterator it = props.begin(); it != props.end(); ++it) {
+        if (it != props.begin())
+            out += ',';
+        appendJCalProperty(out, *it);
+    }
+    
+    out += "],[";
+    icalcompiter itr = icalcomponent_begin_component(comp, ICAL_ANY_COMPONENT);
+    bool first = true;
+    for (icalcomponent* child = icalcompiter_deref(&itr); child != 0; child = icalcompiter_next(&itr)) {
+        if (!first)
+            out += ',';
+        first = false;
+        writeJCal(child, out);
+    }
+    out += "]]";
+}
+
+/**************************************************************************************************
+ **                                        INPUT                                                 **
+ **************************************************************************************************/
+
+// Append a code point as UTF-8
+static void appendUtf8(std::string& out, unsigned long cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Remove separators from jCal dates and times (1997-07-14T12:00:00Z => 19970714T120000Z)
+static void stripTimeSeparators(std::string& text, bool keepSign) {
+    std::string::iterator out = text.begin();
+    for (std::string::iterator in = text.begin(); in != text.end(); ++in) {
+        if (*in == ':' || (*in == '-' && !(keepSign && in == text.begin())))
+            continue;
+        *out++ = *in;
+    }
+    text.erase(out, text.end());
+}
+
+// Reads jCal straight into libical objects.  The JSON is walked once; values are converted as they're read.
+class JCalParser {
+public:
+    JCalParser(const char* b, const char* e) : start(b), pos(b), end(e) { }
+    
+    icalcomponent* parse(std::string& errorText) {
+        icalcomponent* comp = parseComponent(0);
+        if (comp) {
+            skipSpace();
+            if (pos != end) {
+                icalcomponent_free(comp);
+                comp = 0;
+                fail("Unexpected data after the component");
+            }
+        }
+        if (!comp)
+            errorText = error;
+        return comp;
+    }
+    
+private:
+    const char* start;
+    const char* pos;
+    const char* end;
+    std::string error;
+    
+    bool fail(const char* message) {
+        if (error.empty())
+            error = str(format("%s at offset %d") % message % static_cast<long>(pos - start));
+        return false;
+    }
+    
+    void skipSpace() {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n'))
+            ++pos;
+    }
+    
+    // Skip whitespace and check the next character
+    bool peek(char c) {
+        skipSpace();
+        return (pos < end && *pos == c);
+    }
+    
+    bool expect(char c) {
+        if (!peek(c))
+            return fail(str(format("Expected '%c'") % c).c_str());
+        ++pos;
+        return true;
+    }
+    
+    // After an element of an array or object: returns true if another follows, false at the closing bracket
+    bool more(char close, bool& ok) {
+        skipSpace();
+        if (pos < end && *pos == ',') {
+            ++pos;
+            return true;
+        }
+        ok = expect(close);
+        return false;
+    }
+    
+    bool parseHex(unsigned long& v) {
+        if (end - pos < 4)
+            return fail("Bad unicode escape");
+        v = 0;
+        for (int i = 0; i < 4; i++, pos++) {
+            char c = *pos;
+            v <<= 4;
+            if (c >= '0' && c <= '9') v |= static_cast<unsigned long>(c - '0');
+            else if (c >= 'a' && c <= 'f') v |= static_cast<unsigned long>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') v |= static_cast<unsigned long>(c - 'A' + 10);
+            else return fail("Bad unicode escape");
+        }
+        return true;
+    }
+    
+    bool parseString(std::string& out) {
+        out.clear();
+        if (!expect('"'))
+            return false;
+        
+        while (pos < end) {
+            // Copy runs of plain characters in one go
+            const char* run = pos;
+            while (pos < end && *pos != '"' && *pos != '\\')
+                ++pos;
+            out.append(run, pos);
+            if (pos >= end)
+                break;
+            
+            if (*pos == '"') {
+                ++pos;
+                return true;
+            }
+            
+            // Escape
+            if (++pos >= end)
+                break;
+            unsigned long cp, low;
+            switch (*pos++) {
+                case '"':  out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/':  out += '/'; break;
+                case 'b':  out += '\b'; break;
+                case 'f':  out += '\f'; break;
+                case 'n':  out += '\n'; break;
+                case 'r':  out += '\r'; break;
+                case 't':  out += '\t'; break;
+                case 'u':
+                    if (!parseHex(cp))
+                        return false;
+                    if (cp >= 0xD800 && cp <= 0xDBFF) {
+                        // Surrogate pair
+                        if (end - pos < 2 || pos[0] != '\\' || pos[1] != 'u')
+                            return fail("Bad surrogate pair");
+                        pos += 2;
+                        if (!parseHex(low) || low < 0xDC00 || low > 0xDFFF)
+                            return fail("Bad surrogate pair");
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, cp);
+                    break;
+                default:
+                    return fail("Bad escape");
+            }
+        }
+        return fail("Unterminated string");
+    }
+    
+    // A string, number or boolean as ICS text
+    bool parseScalar(std::string& out) {
+        skipSpace();
+        if (pos >= end)
+            return fail("Expected a value");
+        
+        if (*pos == '"')
+            return parseString(out);
+        
+        const char* token = pos;
+        while (pos < end && ((*pos >= '0' && *pos <= '9') || (*pos >= 'a' && *pos <= 'z') || *pos == '-' || *pos == '+' || *pos == '.' || *pos == 'E'))
+            ++pos;
+        out.assign(token, pos);
+        
+        if (out == "true") {
+            out = "TRUE";
+        } else if (out == "false") {
+            out = "FALSE";
+        } else if (out.empty() || out == "null" || !((out[0] >= '0' && out[0] <= '9') || out[0] == '-')) {
+            pos = token;
+            return fail("Expected a value");
+        }
+        return true;
+    }
+    
+    // A jCal value as ICS value text.  Arrays are structured values (GEO, REQUEST-STATUS) and objects are RRULEs.
+    bool parseValueText(std::string& out, const std::string& type) {
+        std::string part;
+        bool ok = true;
+        out.clear();
+        
+        if (peek('[')) {
+            ++pos;
+            if (peek(']')) {
+                ++pos;
+                return true;
+            }
+            bool first = true;
+            do {
+                if (!parseScalar(part))
+                    return false;
+                if (!first)
+                    out += ';';
+                first = false;
+                out += part;
+            } while (more(']', ok));
+            return ok;
+        }
+        
+        if (peek('{')) {
+            // RRULE, with FREQ first
+            std::string key, values;
+            ++pos;
+            if (peek('}')) {
+                ++pos;
+                return true;
+            }
+            do {
+                if (!parseString(key) || !expect(':'))
+                    return false;
+                boost::algorithm::to_upper(key);
+                
+                values.clear();
+                if (peek('[')) {
+                    ++pos;
+                    if (!peek(']')) {
+                        do {
+                            if (!parseScalar(part))
+                                return false;
+                            if (!values.empty())
+                                values += ',';
+                            values += part;
+                        } while (more(']', ok));
+                        if (!ok)
+                            return false;
+                    } else {
+                        ++pos;
+                    }
+                } else if (!parseScalar(values)) {
+                    return false;
+                }
+                if (key == "UNTIL")
+                    stripTimeSeparators(values, false);
+                
+                part = key + "=" + values;
+                if (key == "FREQ") {
+                    out = (out.empty() ? part : part + ";" + out);
+                } else {
+                    if (!out.empty())
+                        out += ';';
+                    out += part;
+                }
+            } while (more('}', ok));
+            return ok;
+        }
+        
+        if (!parseScalar(out))
+            return false;
+        
+        if (type == "date" || type == "date-time" || type == "period" || type == "time") {
+            stripTimeSeparators(out, false);
+        } else if (type == "utc-offset") {
+            stripTimeSeparators(out, true);
+        }
+        return true;
+    }
+    
+    // Create a value of the kind the jCal type names for a property
+    icalvalue* createValue(icalproperty_kind propKind, const std::string& type, const std::string& text) {
+        icalvalue_kind defaultKind = icalproperty_kind_to_value_kind(propKind);
+        icalvalue_kind kind;
+        
+        if (type == "unknown") {
+            // Unknown values are ICS text
+            if (propKind == ICAL_X_PROPERTY || defaultKind == ICAL_NO_VALUE || defaultKind == ICAL_X_VALUE)
+                return icalvalue_new_x(text.c_str());
+            kind = defaultKind;
+        } else if (type == "text") {
+            // Enumerated properties (STATUS, CLASS...) are text in jCal
+            if (defaultKind == ICAL_TEXT_VALUE || defaultKind == ICAL_X_VALUE || defaultKind == ICAL_NO_VALUE || propKind == ICAL_X_PROPERTY)
+                return icalvalue_new_text(text.c_str());
+            icalvalue* value = icalvalue_new_from_string(defaultKind, text.c_str());
+            return (value ? value : icalvalue_new_text(text.c_str()));
+        } else {
+            kind = icalvalue_string_to_kind(boost::algorithm::to_upper_copy(type).c_str());
+            if (kind == ICAL_NO_VALUE) {
+                kind = defaultKind;
+            } else if (defaultKind == ICAL_TRIGGER_VALUE && (kind == ICAL_DURATION_VALUE || kind == ICAL_DATETIME_VALUE)) {
+                kind = ICAL_TRIGGER_VALUE;
+            } else if (defaultKind == ICAL_ATTACH_VALUE && kind == ICAL_URI_VALUE) {
+                kind = ICAL_ATTACH_VALUE;
+            } else if (defaultKind == ICAL_GEO_VALUE && kind == ICAL_FLOAT_VALUE) {
+                // GEO is a "float" array in jCal
+                kind = ICAL_GEO_VALUE;
+            }
+        }
+        
+        if (kind == ICAL_TEXT_VALUE)
+            return icalvalue_new_text(text.c_str());
+        if (kind == ICAL_NO_VALUE || kind == ICAL_X_VALUE)
+            return icalvalue_new_x(text.c_str());
+        return icalvalue_new_from_string(kind, text.c_str());
+    }
+    
+    // Parameter values that are arrays are joined with commas
+    bool parseParameters(icalproperty* prop) {
+        std::string name, value, part;
+        bool ok = true;
+        
+        if (!expect('{'))
+            return false;
+        if (peek('}')) {
+            ++pos;
+            return true;
+        }
+        
+        do {
+            if (!parseString(name) || !expect(':'))
+                return false;
+            boost::algorithm::to_upper(name);
+            
+            value.clear();
+            if (peek('[')) {
+                ++pos;
+                if (!peek(']')) {
+                    do {
+                        if (!parseScalar(part))
+                            return false;
+                        if (!value.empty())
+                            value += ',';
+                        value += part;
+                    } while (more(']', ok));
+                    if (!ok)
+                        return false;
+                } else {
+                    ++pos;
+                }
+            } else if (!parseScalar(value)) {
+                return false;
+            }
+            
+            icalparameter_kind kind = icalparameter_string_to_kind(name.c_str());
+            icalparameter* param = 0;
+            if (kind == ICAL_X_PARAMETER || (kind == ICAL_NO_PARAMETER && name.compare(0, 2, "X-") == 0)) {
+                param = icalparameter_new_x(value.c_str());
+                if (param)
+                    icalparameter_set_xname(param, name.c_str());
+            } else if (kind != ICAL_NO_PARAMETER && kind != ICAL_VALUE_PARAMETER) {
+                param = icalparameter_new_from_value_string(kind, value.c_str());
+            }
+            
+            // Unknown parameters are dropped, as they are by the ICS parser
+            if (param)
+                icalproperty_add_parameter(prop, param);
+        } while (more('}', ok));
+        
+        return ok;
+    }
+    
+    // A property and its values.  Each extra value becomes another property with the same parameters.
+    bool parseProperty(icalcomponent* comp) {
+        std::string name, type, text;
+        bool ok = true;
+        
+        if (!expect('[') || !parseString(name))
+            return false;
+        boost::algorithm::to_upper(name);
+        
+        icalproperty_kind kind = icalproperty_string_to_kind(name.c_str());
+        if (kind == ICAL_NO_PROPERTY)
+            kind = ICAL_X_PROPERTY;
+        
+        icalproperty* prop = icalproperty_new(kind);
+        if (!prop)
+            return fail("Unable to create property");
+        if (kind == ICAL_X_PROPERTY)
+            icalproperty_set_x_name(prop, name.c_str());
+        
+        if (!expect(',') || !parseParameters(prop) || !expect(',') || !parseString(type)) {
+            icalproperty_free(prop);
+            return false;
+        }
+        boost::algorithm::to_lower(type);
+        
+        std::vector<icalproperty*> props;
+        props.push_back(prop);
+        while (ok && more(']', ok)) {
+            icalvalue* value = 0;
+            if (parseValueText(text, type)) {
+                value = createValue(kind, type, text);
+                if (!value)
+                    fail(str(format("Invalid %s value for %s") % type % name).c_str());
+            }
+            if (!value) {
+                ok = false;
+                break;
+            }
+            
+            icalproperty* target = props.back();
+            if (icalproperty_get_value(target)) {
+                target = icalproperty_new_clone(prop);
+                props.push_back(target);
+            }
+            icalproperty_set_value(target, value);
+        }
+        
+        if (!ok) {
+            for (std::vector<icalproperty*>::iterator it = props.begin(); it != props.end(); ++it) {
+                icalproperty_free(*it);
+            }
+            return false;
+        }
+        
+        for (std::vector<icalproperty*>::iterator it = props.begin(); it != props.end(); ++it) {
+            icalcomponent_add_property(comp, *it);
+        }
+        return true;
+    }
+    
+    icalcomponent* parseComponent(int depth) {
+        std::string name;
+        bool ok = true;
+        
+        if (depth > kMaxComponentDepth) {
+            fail("Components nested too deeply");
+            return 0;
+        }
+        
+        if (!expect('[') || !parseString(name))
+            return 0;
+        boost::algorithm::to_upper(name);
+        
+        icalcomponent* comp = 0;
+        icalcomponent_kind kind = icalcomponent_string_to_kind(name.c_str());
+        if (kind == ICAL_X_COMPONENT || (kind == ICAL_NO_COMPONENT && name.compare(0, 2, "X-") == 0)) {
+            comp = icalcomponent_new_x(name.c_str());
+        } else if (kind != ICAL_NO_COMPONENT) {
+            comp = icalcomponent_new(kind);
+        }
+        if (!comp) {
+            fail(str(format("Unknown component \"%s\"") % name).c_str());
+            return 0;
+        }
+        
+        // Properties
+        if (!expect(',') || !expect('[')) {
+            icalcomponent_free(comp);
+            return 0;
+        }
+        if (peek(']')) {
+            ++pos;
+        } else {
+            do {
+                ok = parseProperty(comp);
+            } while (ok && more(']', ok));
+        }
+        
+        // Children
+        if (ok && expect(',') && expect('[')) {
+            if (peek(']')) {
+                ++pos;
+            } else {
+                do {
+                    icalcomponent* child = parseComponent(depth + 1);
+                    ok = (child != 0);
+                    if (child)
+                        icalcomponent_add_component(comp, child);
+                } while (ok && more(']', ok));
+            }
+        } else {
+            ok = false;
+        }
+        
+        if (!ok || !expect(']')) {
+            icalcomponent_free(comp);
+            return 0;
+        }
+        
+        return comp;
+    }
+};
+
+icalcomponent* iCalTools::parseJCal(const char* begin, const char* end, std::string& error) {
+    JCalParser parser(begin, end);
+    return parser.parse(error);
+}
\ No newline at end of file
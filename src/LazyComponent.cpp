@@ -0,0 +1,282 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "LazyComponent.he"
+
+#include <boost/algorithm/string.hpp>
+
+#include <cstring>
+#include <cctype>
+
+using namespace iCalTools;
+using boost::shared_ptr;
+
+// Check if a content line is the named property (Name must be upper case)
+static bool isPropertyLine(const char* line, const char* lineEnd, const char* name) {
+    for (; *name; ++line, ++name) {
+        if (line >= lineEnd || toupper(static_cast<unsigned char>(*line)) != *name)
+            return false;
+    }
+    return (line < lineEnd && (*line == ':' || *line == ';'));
+}
+
+// Copy a content line, joining any folded continuation lines, without modifying the buffer.  Returns the start of the next line.
+static char* copyContentLine(char* pos, char* end, std::string& line) {
+    line.clear();
+    
+    while (pos < end) {
+        char* newline = static_cast<char*>(memchr(pos, '\n', end - pos));
+        char* lineEnd = (newline ? newline : end);
+        char* next = (newline ? newline + 1 : end);
+        
+        char* copyEnd = lineEnd;
+        if (copyEnd > pos && *(copyEnd-1) == '\r')
+            copyEnd--;
+        line.append(pos, copyEnd);
+        
+        pos = next;
+        if (pos < end && (*pos == ' ' || *pos == '\t')) {
+            pos++;
+            continue;
+        }
+        break;
+    }
+    
+    return pos;
+}
+
+// Split a DTSTART/DTEND content line into its value text and TZID parameter
+static void readIndexedTime(const std::string& line, std::string& text, std::string& tzid) {
+    // The value starts after the first colon that isn't in a quoted parameter value
+    std::string::size_type valuePos = std::string::npos;
+    bool quoted = false;
+    for (std::string::size_type i = 0; i < line.size(); i++) {
+        if (line[i] == '"') {
+            quoted = !quoted;
+        } else if (line[i] == ':' && !quoted) {
+            valuePos = i;
+            break;
+        }
+    }
+    if (valuePos == std::string::npos)
+        return;
+    
+    std::string params = line.substr(0, valuePos);
+    boost::iterator_range<std::string::iterator> tzidParam = boost::ifind_first(params, ";TZID=");
+    if (!tzidParam.empty()) {
+        std::string::size_type tzidStart = tzidParam.end() - params.begin();
+        std::string::size_type tzidEnd = params.find(';', tzidStart);
+        tzid = params.substr(tzidStart, (tzidEnd == std::string::npos ? std::string::npos : tzidEnd - tzidStart));
+        boost::trim_if(tzid, boost::is_any_of("\""));
+    }
+    
+    text = line.substr(valuePos + 1);
+}
+
+// Turn indexed time text into a time (Floating or UTC, as written)
+static icaltimetype resolveIndexedTime(const std::string& text) {
+    if (text.empty())
+        return icaltime_null_time();
+    return icaltime_from_string(text.c_str());
+}
+
+// Read the indexed properties of a child.  Properties of nested components (e.g. VALARM) are skipped.
+static void readIndexedProperties(LazyComponentEntry& entry) {
+    std::string line;
+    int depth = 0;
+    char* pos = entry.range.begin;
+    char* end = entry.range.end;
+    
+    while (pos < end) {
+        char* newline = static_cast<char*>(memchr(pos, '\n', end - pos));
+        char* lineEnd = (newline ? newline : end);
+        char* next = (newline ? newline + 1 : end);
+        
+        // Continuation lines were read along with the line they belong to
+        if (*pos == ' ' || *pos == '\t') {
+            pos = next;
+            continue;
+        }
+        
+        switch (getContentLineMarker(pos, lineEnd)) {
+            case MARKER_BEGIN:
+                depth++;
+                break;
+            case MARKER_END:
+                depth--;
+                break;
+            default:
+                if (depth == 1) {
+                    if (isPropertyLine(pos, lineEnd, "UID")) {
+                        copyContentLine(pos, end, line);
+                        std::string::size_type valuePos = line.find(':');
+                        if (valuePos != std::string::npos)
+                            entry.uid = line.substr(valuePos + 1);
+                    } else if (isPropertyLine(pos, lineEnd, "DTSTART")) {
+                        copyContentLine(pos, end, line);
+                        readIndexedTime(line, entry.dtstartText, entry.dtstartTZID);
+                    } else if (isPropertyLine(pos, lineEnd, "DTEND")) {
+                        copyContentLine(pos, end, line);
+                        readIndexedTime(line, entry.dtendText, entry.dtendTZID);
+                    }
+                }
+                break;
+        }
+        
+        pos = next;
+    }
+}
+
+LazyComponentIndex::LazyComponentIndex(shared_ptr<MappedFile> f) : cursor(0), file(f), root(0), complete(false) { }
+
+shared_ptr<LazyComponentIndex> LazyComponentIndex::create(shared_ptr<MappedFile> file) {
+    shared_ptr<LazyComponentIndex> index;
+    
+    ComponentLayout layout;
+    if (!file || !file->isOpen() || !scanComponentLayout(file->data(), file->data() + file->size(), layout)) {
+        return index;
+    }
+    
+    // Parse the root's own content lines (BEGIN, properties, END)
+    shared_ptr<icalparser> parser(icalparser_new(), icalparser_free);
+    icalcomponent* root = 0;
+    for (std::vector<ContentRange>::iterator it = layout.rootLines.begin(); it != layout.rootLines.end() && !root; ++it) {
+        char* pos = it->begin;
+        root = parseContentLines(parser.get(), pos, it->end);
+    }
+    if (!root) {
+        return index;
+    }
+    
+    index = shared_ptr<LazyComponentIndex>(new LazyComponentIndex(file));
+    index->root = root;
+    index->entries.reserve(layout.children.size());
+    
+    std::string compName;
+    for (std::vector<ContentRange>::iterator it = layout.children.begin(); it != layout.children.end(); ++it) {
+        char* newline = static_cast<char*>(memchr(it->begin, '\n', it->end - it->begin));
+        getContentLineMarker(it->begin, (newline ? newline : it->end), &compName);
+        
+        index->entries.push_back(LazyComponentEntry(*it, icalcomponent_string_to_kind(compName.c_str())));
+        readIndexedProperties(index->entries.back());
+    }
+    
+    // Nothing to defer
+    if (index->entries.empty()) {
+        index->complete = true;
+        index->file.reset();
+    }
+    
+    return index;
+}
+
+int LazyComponentIndex::count(icalcomponent_kind kind) {
+    if (kind == ICAL_ANY_COMPONENT)
+        return static_cast<int>(entries.size());
+    
+    int total = 0;
+    for (std::vector<LazyComponentEntry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+        if (it->kind == kind)
+            total++;
+    }
+    return total;
+}
+
+std::size_t LazyComponentIndex::find(icalcomponent_kind kind, std::size_t from) {
+    for (std::size_t i = from; i < entries.size(); i++) {
+        if (kind == ICAL_ANY_COMPONENT || entries[i].kind == kind)
+            return i;
+    }
+    return npos;
+}
+
+std::size_t LazyComponentIndex::findUID(const std::string& uid, std::size_t from) {
+    for (std::size_t i = from; i < entries.size(); i++) {
+        if (entries[i].uid == uid)
+            return i;
+    }
+    return npos;
+}
+
+icaltimetype LazyComponentIndex::getStart(std::size_t i, std::string& tzid) {
+    if (i >= entries.size())
+        return icaltime_null_time();
+    
+    tzid = entries[i].dtstartTZID;
+    return resolveIndexedTime(entries[i].dtstartText);
+}
+
+icaltimetype LazyComponentIndex::getEnd(std::size_t i, std::string& tzid) {
+    if (i >= entries.size())
+        return icaltime_null_time();
+    
+    tzid = entries[i].dtendTZID;
+    return resolveIndexedTime(entries[i].dtendText);
+}
+
+icalcomponent* LazyComponentIndex::getComponent(std::size_t i) {
+    if (i >= entries.size())
+        return 0;
+    
+    LazyComponentEntry& entry = entries[i];
+    if (!entry.parsed) {
+        // Reading past the end of a file that's been cut short since it was mapped would fault
+        if (!file || !file->isIntact())
+            return 0;
+        
+
+        // The range is unfolded in place as it's parsed, so it can only be parsed once
+        entry.parsed = true;
+        
+        shared_ptr<icalparser> parser(icalparser_new(), icalparser_free);
+        char* pos = entry.range.begin;
+        entry.comp = parseContentLines(parser.get(), pos, entry.range.end);
+        if (entry.comp) {
+            icalcomponent_add_component(root, entry.comp);
+        }
+    }
+    
+    return entry.comp;
+}
+
+void LazyComponentIndex::materializeAll() {
+    if (complete)
+        return;
+    
+    // Children are appended as they're parsed, so move the ones parsed earlier back into file order
+    for (std::size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].parsed) {
+            if (entries[i].comp) {
+                icalcomponent_remove_component(root, entries[i].comp);
+                icalcomponent_add_component(root, entries[i].comp);
+            }
+        } else {
+            getComponent(i);
+        }
+    }
+    
+    // Everything now lives in the root, so the file and index can go
+    entries.clear();
+    cursor = 0;
+    file.reset();
+    complete = true;
+}
\ No newline at end of file
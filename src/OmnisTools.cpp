@@ -300,6 +300,31 @@ std::string OmnisTools::getStringFromEXTFldVal(EXTfldval& fVal) {
 	return retString;
 }
 
+// Get UTF-8 data from an EXTfldval object without the intermediate std::string.
+// Binary fields are expected to already hold UTF-8 and are copied as-is; character fields are 
+// converted in place inside the buffer.  The returned pointer is only valid until the buffer is next resized.
+char* OmnisTools::getUtf8FromEXTFldVal(EXTfldval& fVal, std::vector<qchar>& buffer, qlong& length) {
+	ffttype fft; fVal.getType(fft);
+	qlong binLength = fVal.getBinLen();
+	length = 0;
+	
+	if (fft == fftBinary) {
+		// Raw bytes (Room for at least one element so the buffer always has an address)
+		buffer.resize(binLength / sizeof(qchar) + 1);
+		fVal.getBinary(binLength, reinterpret_cast<qbyte*>(&buffer[0]), length);
+	} else {
+		// Get a qchar* string
+		qlong maxLength = binLength+1; // Use binary length as approximation of maximum size
+		buffer.resize(maxLength);
+		fVal.getChar(maxLength, &buffer[0], length);
+		
+		// Translate qchar* string into UTF8 binary (The UTF8 form is never longer than the qchar form)
+		length = CHRunicode::charToUtf8(&buffer[0], length, reinterpret_cast<qbyte*>(&buffer[0]));
+	}
+	
+	return reinterpret_cast<char*>(&buffer[0]);
+}
+
 // Set an existing EXTfldval object from a std::string
 void OmnisTools::getEXTFldValFromString(EXTfldval& fVal, const std::string readString) {
 	qlong length;
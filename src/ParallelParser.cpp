@@ -0,0 +1,159 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "ParallelParser.he"
+#include "iCalTools.he"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <vector>
+
+using namespace iCalTools;
+using boost::shared_ptr;
+
+// Fewer children than this per thread isn't worth the cost of starting the thread
+const static std::size_t kMinChildrenPerThread = 64;
+
+// libical keeps icalerrno and its temporary string buffers per thread only when it's built with pthreads (The 
+// configure builds on Mac and Linux).  The CMake build used for Windows keeps them global, so it parses on one 
+// thread.  Either way the error state table is shared, so nothing may call icalerror_set_error_state while a 
+// parse is running (This component never does).
+#ifdef iswin32
+const static bool kParseThreadsSafe = false;
+#else
+const static bool kParseThreadsSafe = true;
+#endif
+
+// Parses a contiguous run of children.  Every chunk owns its parser and a separate part of the buffer and 
+// results; the only libical state they share is described above.
+class ParseChunk {
+public:
+    ParseChunk(const std::vector<ContentRange>* c, std::vector<icalcomponent*>* r, std::size_t f, std::size_t l) 
+        : children(c), results(r), first(f), last(l) 
+    { }
+    
+    void operator()() {
+        shared_ptr<icalparser> parser(icalparser_new(), icalparser_free);
+        
+        for (std::size_t i = first; i < last; i++) {
+            char* pos = (*children)[i].begin;
+            (*results)[i] = parseContentLines(parser.get(), pos, (*children)[i].end);
+            
+            // A child that didn't parse leaves the parser part way through a component, so start again with a new one
+            if (!(*results)[i]) {
+                parser = shared_ptr<icalparser>(icalparser_new(), icalparser_free);
+            }
+        }
+    }
+    
+private:
+    const std::vector<ContentRange>* children;
+    std::vector<icalcomponent*>* results;
+    std::size_t first;
+    std::size_t last;
+};
+
+icalcomponent* iCalTools::parseComponentParallel(char* begin, char* end, unsigned int threadCount) {
+    shared_ptr<icalparser> parser(icalparser_new(), icalparser_free);
+    char* pos;
+    
+    // Locate the children.  If the layout can't be worked out just parse the buffer in one go.
+    ComponentLayout layout;
+    if (!scanComponentLayout(begin, end, layout)) {
+        pos = begin;
+        return parseContentLines(parser.get(), pos, end);
+    }
+    
+    // Parse the root's own lines (BEGIN, properties and END) to get the root without any children
+    icalcomponent* root = 0;
+    for (std::size_t i = 0; i < layout.rootLines.size() && !root; i++) {
+        pos = layout.rootLines[i].begin;
+        root = parseContentLines(parser.get(), pos, layout.rootLines[i].end);
+    }
+    if (!root) {
+        return 0;
+    }
+    
+    // Work out the number of chunks
+    std::size_t childCount = layout.children.size();
+    if (!kParseThreadsSafe) {
+        threadCount = 1;
+    } else if (threadCount == 0) {
+        threadCount = boost::thread::hardware_concurrency();
+    }
+    std::size_t chunkCount = childCount / kMinChildrenPerThread;
+    if (chunkCount > threadCount) {
+        chunkCount = threadCount;
+    }
+    if (chunkCount < 1) {
+        chunkCount = 1;
+    }
+    
+    // Split the children into chunks of roughly equal size (in bytes) and parse them
+    std::vector<icalcomponent*> results(childCount, static_cast<icalcomponent*>(0));
+    if (chunkCount == 1) {
+        ParseChunk(&layout.children, &results, 0, childCount)();
+    } else {
+        std::size_t totalBytes = (childCount > 0 ? layout.children.back().end - layout.children.front().begin : 0);
+        std::size_t bytesPerChunk = totalBytes / chunkCount + 1;
+        
+        boost::thread_group workers;
+        std::size_t first = 0, chunkBytes = 0;
+        for (std::size_t i = 0; i < childCount; i++) {
+            chunkBytes += layout.children[i].end - layout.children[i].begin;
+            if (chunkBytes >= bytesPerChunk || i == childCount-1) {
+                ParseChunk chunk(&layout.children, &results, first, i+1);
+                try {
+                    workers.create_thread(chunk);
+                } catch (boost::thread_resource_error&) {
+                    // Out of threads, so parse this chunk here
+                    chunk();
+                }
+                first = i+1;
+                chunkBytes = 0;
+            }
+        }
+        workers.join_all();
+    }
+    
+    // A child that doesn't parse on its own would be kept with its errors by a serial parse, so give up rather 
+    // than lose it
+    for (std::size_t i = 0; i < childCount; i++) {
+        if (!results[i]) {
+            for (std::size_t j = 0; j < childCount; j++) {
+                if (results[j]) {
+                    icalcomponent_free(results[j]);
+                }
+            }
+            icalcomponent_free(root);
+            return 0;
+        }
+    }
+    
+    // Stitch the children back together in their original order
+    for (std::size_t i = 0; i < childCount; i++) {
+        icalcomponent_add_component(root, results[i]);
+    }
+    
+    return root;
+}
\ No newline at end of file
@@ -24,6 +24,10 @@
 #include "Recurrence.he"
 #include "Constants.he"
 #include "iCalTools.he"
+#include "RecurrenceIterator.he"
+#include "RecurrenceIteratorObj.he"
+#include "ZoneTransitions.he"
+#include "EpochArray.he"
 
 #include "SystemDate.h"
 
@@ -59,6 +63,7 @@ void NVObjRecurrence::copy( NVObjRecurrence* pObj ) {
     NVObjBase::copy(pObj);
     
     recur = pObj->recur;
+    compiled = pObj->compiled;
 }
 
 /**************************************************************************************************
@@ -69,7 +74,15 @@ void NVObjRecurrence::copy( NVObjRecurrence* pObj ) {
 const static qshort cRecurrenceMethodError      = 9000,
                     cRecurrenceMethodInitialize  = 9001,
                     cRecurrenceMethodClear      = 9002,
-                    cRecurrenceMethodDatesUntil = 9003;
+                    cRecurrenceMethodDatesUntil = 9003,
+                    cRecurrenceMethodExpandDates = 9004,
+                    cRecurrenceMethodOccurrenceCount = 9005,
+                    cRecurrenceMethodNthOccurrence = 9006,
+                    cRecurrenceMethodLastOccurrence = 9007,
+                    cRecurrenceMethodOccursOn = 9008,
+                    cRecurrenceMethodCompile = 9009,
+                    cRecurrenceMethodIterator = 9010,
+                    cRecurrenceMethodExpandEpochs = 9011;
 
 
 // Table of parameter resources and types.
@@ -105,6 +118,29 @@ ECOparam cRecurrenceMethodsParamsTable[] =
     // $datesUntil
     9817, fftObject, 0, 0,
     9818, fftObject,   EXTD_FLAG_PARAMOPT, 0,
+    // $expandDates
+    9819, fftObject,   0, 0,
+    9820, fftObject,   EXTD_FLAG_PARAMOPT, 0,
+    9821, fftConstant, EXTD_FLAG_PARAMOPT, 0,
+    9822, fftBoolean,  EXTD_FLAG_PARAMOPT, 0,
+    // $occurrenceCount
+    9823, fftObject,   0, 0,
+    9824, fftObject,   EXTD_FLAG_PARAMOPT, 0,
+    // $nthOccurrence
+    9825, fftObject,   0, 0,
+    9826, fftInteger,  0, 0,
+    // $lastOccurrence
+    9827, fftObject,   0, 0,
+    9828, fftObject,   EXTD_FLAG_PARAMOPT, 0,
+    // $occursOn
+    9829, fftObject,   0, 0,
+    9830, fftObject,   0, 0,
+    // $iterator
+    9831, fftObject,   0, 0,
+    // $expandEpochs
+    9832, fftObject,   0, 0,
+    9833, fftObject,   EXTD_FLAG_PARAMOPT, 0,
+    9834, fftInteger,  EXTD_FLAG_PARAMOPT, 0,
 };
 
 // Table of Methods available
@@ -121,7 +157,15 @@ ECOmethodEvent cRecurrenceMethodsTable[] =
 	cRecurrenceMethodError,      cRecurrenceMethodError,      fftNumber, 4, &cRecurrenceMethodsParamsTable[0], 0, 0,
     cRecurrenceMethodInitialize, cRecurrenceMethodInitialize, fftNone,  13, &cRecurrenceMethodsParamsTable[4], 0, 0,
     cRecurrenceMethodClear,      cRecurrenceMethodClear,      fftNone,   0, 0, 0, 0,
-    cRecurrenceMethodDatesUntil, cRecurrenceMethodDatesUntil, fftList,   2, &cRecurrenceMethodsParamsTable[17], 0, 0
+    cRecurrenceMethodDatesUntil, cRecurrenceMethodDatesUntil, fftList,   2, &cRecurrenceMethodsParamsTable[17], 0, 0,
+    cRecurrenceMethodExpandDates, cRecurrenceMethodExpandDates, fftList, 4, &cRecurrenceMethodsParamsTable[19], 0, 0,
+    cRecurrenceMethodOccurrenceCount, cRecurrenceMethodOccurrenceCount, fftInteger, 2, &cRecurrenceMethodsParamsTable[23], 0, 0,
+    cRecurrenceMethodNthOccurrence, cRecurrenceMethodNthOccurrence, fftObject, 2, &cRecurrenceMethodsParamsTable[25], 0, 0,
+    cRecurrenceMethodLastOccurrence, cRecurrenceMethodLastOccurrence, fftObject, 2, &cRecurrenceMethodsParamsTable[27], 0, 0,
+    cRecurrenceMethodOccursOn, cRecurrenceMethodOccursOn, fftBoolean, 2, &cRecurrenceMethodsParamsTable[29], 0, 0,
+    cRecurrenceMethodCompile, cRecurrenceMethodCompile, fftBoolean, 0, 0, 0, 0,
+    cRecurrenceMethodIterator, cRecurrenceMethodIterator, fftObject, 1, &cRecurrenceMethodsParamsTable[31], 0, 0,
+    cRecurrenceMethodExpandEpochs, cRecurrenceMethodExpandEpochs, fftBinary, 3, &cRecurrenceMethodsParamsTable[32], 0, 0
 };
 
 // List of methods in Simple
@@ -157,6 +201,30 @@ qlong NVObjRecurrence::methodCall( tThreadData* pThreadData )
         case cRecurrenceMethodDatesUntil:
 			result = methodDatesUntil(pThreadData, paramCount);
 			break;
+        case cRecurrenceMethodExpandDates:
+			result = methodExpandDates(pThreadData, paramCount);
+			break;
+        case cRecurrenceMethodOccurrenceCount:
+			result = methodOccurrenceCount(pThreadData, paramCount);
+			break;
+        case cRecurrenceMethodNthOccurrence:
+			result = methodNthOccurrence(pThreadData, paramCount);
+			break;
+        case cRecurrenceMethodLastOccurrence:
+			result = methodLastOccurrence(pThreadData, paramCount);
+			break;
+        case cRecurrenceMethodOccursOn:
+			result = methodOccursOn(pThreadData, paramCount);
+			break;
+        case cRecurrenceMethodCompile:
+			result = methodCompile(pThreadData, paramCount);
+			break;
+        case cRecurrenceMethodIterator:
+			result = methodIterator(pThreadData, paramCount);
+			break;
+        case cRecurrenceMethodExpandEpochs:
+			result = methodExpandEpochs(pThreadData, paramCount);
+			break;
 	}
 	
 	callErrorMethod(pThreadData, result);
@@ -669,6 +737,30 @@ void NVObjRecurrence::clear()
     recur.count = 0;
 }
 
+// UNTIL in UTC, to compare with the UTC dates the rule is iterated from
+static icaltimetype getUntilUTC(const icalrecurrencetype& rule) {
+    icaltimetype until = rule.until;
+    if (!icaltime_is_null_time(until) && !until.is_date && !until.is_utc) {
+        ZoneTransitions untilZone(const_cast<icaltimezone*>(until.zone));
+        untilZone.convertToUTC(until);
+        until.zone = icaltimezone_get_utc_timezone();
+        until.is_utc = 1;
+    }
+    return until;
+}
+
+// The rule compiled into a generator, with UNTIL in UTC so comparing dates with it never converts them in a zone.  
+// Compiled again if the rule has changed since (Properties and $initialize assign the parts of the rule directly).
+shared_ptr<CompiledRecurrence> NVObjRecurrence::getCompiled()
+{
+    icalrecurrencetype rule = recur;
+    rule.until = getUntilUTC(recur);
+    if (!compiled || memcmp(&compiled->getRule(), &rule, sizeof(icalrecurrencetype)) != 0) {
+        compiled = boost::make_shared<CompiledRecurrence>(rule);
+    }
+    return compiled;
+}
+
 /**************************************************************************************************
  **                              CUSTOM (YOUR) METHODS                                           **
  **************************************************************************************************/
@@ -841,15 +933,10 @@ tResult NVObjRecurrence::methodClear( tThreadData* pThreadData, qshort pParamCou
     return METHOD_OK;
 }
 
-// Returns a list of dates up until the To date (param 1) and optionally dates only past the From date (param 2)
-const static int MAX_ROWS = 50000;
-tResult NVObjRecurrence::methodDatesUntil( tThreadData* pThreadData, qshort pParamCount )
-{    
-    if (pParamCount != 2) {
-        pThreadData->mExtraErrorText = "Invalid parameters.  Requires exactly 2 parameters, (1) 'From' Date and (2) 'To' Date.";
-        return METHOD_FAILED;
-    }
-    
+// Reads the From date (param 1) and the To date or maximum rows (param 2) for $datesUntil and $expandDates.
+// Both dates are converted to UTC.  fromZone is set to the zone of the From date, which the results are returned in.
+static tResult getExpansionRange( tThreadData* pThreadData, icaltimetype& fromDate, icaltimetype& toDate, icaltimezone*& fromZone, qlong& maxRows )
+{
     EXTfldval fromDateVal, param2Val;
     NVObjDate *omnisDateObj;
     SystemTimeZone curZone;
@@ -859,7 +946,6 @@ tResult NVObjRecurrence::methodDatesUntil( tThreadData* pThreadData, qshort pPar
         pThreadData->mExtraErrorText = "Parameter 1, From Date, is unrecognized.  Expected Date object.";
         return METHOD_FAILED;
     }
-    icaltimetype fromDate;
     if( getType(fromDateVal).valType == fftDate) {
         // Passed Omnis date or Date object
         fromDate = getTimeTypeFromEXTFldVal(pThreadData, fromDateVal);
@@ -875,11 +961,13 @@ tResult NVObjRecurrence::methodDatesUntil( tThreadData* pThreadData, qshort pPar
             pThreadData->mExtraErrorText = "Parameter 1, From Date, is unrecognized.  Expected Date object.";
             return METHOD_FAILED;
         }
+    } else {
+        pThreadData->mExtraErrorText = "Parameter 1, From Date, is unrecognized.  Expected Date object.";
+        return METHOD_FAILED;
     }
         
     // Parameter 2: (Optional) To Date
-    icaltimetype toDate = icaltime_null_time();
-    int maxRows = MAX_ROWS;
+    toDate = icaltime_null_time();
     if( getParamVar(pThreadData, 2, param2Val) == qtrue) {
         if (getType(param2Val).valType == fftInteger) {
             // Passed maximum number of returned lines
@@ -901,10 +989,31 @@ tResult NVObjRecurrence::methodDatesUntil( tThreadData* pThreadData, qshort pPar
     }
     
     // Convert dates/times to UTC
-    icaltimezone* utcZone = icaltimezone_get_utc_timezone();
-    icaltimezone* fromZone = const_cast<icaltimezone*>(fromDate.zone);
-    icaltimezone_convert_time(&fromDate, fromZone, utcZone);
-    icaltimezone_convert_time(&toDate, const_cast<icaltimezone*>(toDate.zone), utcZone);
+    fromZone = const_cast<icaltimezone*>(fromDate.zone);
+    ZoneTransitions fromZoneTransitions(fromZone);
+    fromZoneTransitions.convertToUTC(fromDate);
+    ZoneTransitions toZoneTransitions(const_cast<icaltimezone*>(toDate.zone));
+    toZoneTransitions.convertToUTC(toDate);
+    
+    return METHOD_OK;
+}
+
+// Returns a list of dates up until the To date (param 1) and optionally dates only past the From date (param 2)
+const static int MAX_ROWS = 50000;
+tResult NVObjRecurrence::methodDatesUntil( tThreadData* pThreadData, qshort pParamCount )
+{    
+    if (pParamCount != 2) {
+        pThreadData->mExtraErrorText = "Invalid parameters.  Requires exactly 2 parameters, (1) 'From' Date and (2) 'To' Date.";
+        return METHOD_FAILED;
+    }
+    
+    icaltimetype fromDate, toDate;
+    icaltimezone* fromZone = 0;
+    qlong maxRows = MAX_ROWS;
+    tResult result = getExpansionRange(pThreadData, fromDate, toDate, fromZone, maxRows);
+    if (result != METHOD_OK) {
+        return result;
+    }
     
     // Create list
     EXTqlist* retList = new EXTqlist(listVlen);
@@ -916,16 +1025,19 @@ tResult NVObjRecurrence::methodDatesUntil( tThreadData* pThreadData, qshort pPar
     retList->addCol(fftDate,dpFdtimeC,0,&colName);
     
     // Iterate
-	icalrecur_iterator* it = icalrecur_iterator_new(recur, fromDate);
-    if( it == 0) {
+    shared_ptr<CompiledRecurrence> rule = getCompiled();
+    shared_ptr<RecurrenceGenerator> it = rule->createGenerator(fromDate);
+    if( !it->isValid() ) {
         pThreadData->mExtraErrorText = str(format("Unable to determine dates. Error: %s") % icalerror_strerror(icalerrno));
         return ERR_METHOD_FAILED;
     }
     
-    icaltimetype curDate = icalrecur_iterator_next(it);
-    qshort row = 0;
-    EXTfldval colVal, dateVal;
-    NVObjDate *beforeDate, *afterDate;
+    // The dates are in order, so convert them along a table of the zone's offsets
+    ZoneTransitions fromZoneTransitions(fromZone);
+    
+    icaltimetype curDate = it->next();
+    qlong row = 0;
+    EXTfldval colVal;
     while(!icaltime_is_null_time(curDate) 
           && (icaltime_is_null_time(toDate) || (!icaltime_is_null_time(toDate) && icaltime_compare(curDate,toDate) <= 0))
           && row < maxRows) {
@@ -937,26 +1049,18 @@ tResult NVObjRecurrence::methodDatesUntil( tThreadData* pThreadData, qshort pPar
         curDate.is_utc = 0;
         
         // Convert to timezone of the first date
-        icaltimezone_convert_time(&curDate, utcZone, fromZone);
-        
-        getEXTFldValFromTimeType(dateVal, curDate, qtrue, pThreadData);
-        beforeDate = getObjForEXTfldval<NVObjDate>(pThreadData, dateVal);
+        fromZoneTransitions.convertFromUTC(curDate);
         
         // Date object
         retList->getColValRef(row, 1, colVal, qtrue);
         getEXTFldValFromTimeType(colVal, curDate, qtrue, pThreadData);
-        colVal = dateVal;
-        
-        afterDate = getObjForEXTfldval<NVObjDate>(pThreadData, colVal);
         
         // Omnis date
         retList->getColValRef(row, 2, colVal, qtrue);
         getEXTFldValFromTimeType(colVal, curDate, qfalse, pThreadData);
         
-        curDate = icalrecur_iterator_next(it);
+        curDate = it->next();
     }
-    // Free iterator
-    icalrecur_iterator_free(it);
     
     EXTfldval retVal;
     retVal.setList(retList,qtrue);
@@ -964,3 +1068,442 @@ tResult NVObjRecurrence::methodDatesUntil( tThreadData* pThreadData, qshort pPar
     
     return METHOD_DONE_RETURN;
 }
+
+
+// Largest list $expandDates will build when it's given a To date
+const static qlong MAX_EXPAND_ROWS = 10000000;
+
+// Returns a list of dates like $datesUntil, but as plain Omnis date-times and/or UTC epoch seconds (param 3).  Date 
+// objects are only created if asked for (param 4), so large expansions don't create an Omnis object per occurrence.
+tResult NVObjRecurrence::methodExpandDates( tThreadData* pThreadData, qshort pParamCount )
+{    
+    icaltimetype fromDate, toDate;
+    icaltimezone* fromZone = 0;
+    qlong maxRows = -1;
+    tResult result = getExpansionRange(pThreadData, fromDate, toDate, fromZone, maxRows);
+    if (result != METHOD_OK) {
+        return result;
+    }
+    if (maxRows < 0) {
+        maxRows = (icaltime_is_null_time(toDate) ? MAX_ROWS : MAX_EXPAND_ROWS);
+    }
+    icaltimezone* utcZone = icaltimezone_get_utc_timezone();
+    
+    // Parameter 3: (Optional) Columns
+    EXTfldval columnsVal;
+    ExpandColumns columns = EXPAND_DATETIME;
+    if ( pParamCount >= 3 && getParamVar(pThreadData, 3, columnsVal) == qtrue ) {
+        columns = getICalTypeFromEXTFldVal<ExpandColumns>(columnsVal);
+    }
+    bool withDateTime = (columns == EXPAND_DATETIME || columns == EXPAND_DATETIME_EPOCH);
+    bool withEpoch = (columns == EXPAND_EPOCH || columns == EXPAND_DATETIME_EPOCH);
+    
+    // Parameter 4: (Optional) Add a Date object column
+    qbool withObjects = qfalse;
+    if ( pParamCount >= 4 && getParamBool(pThreadData, 4, withObjects) != qtrue ) {
+        pThreadData->mExtraErrorText = "Parameter 4, Date Objects, is unrecognized.  Expected boolean.";
+        return METHOD_FAILED;
+    }
+    
+    // Iterate
+    shared_ptr<CompiledRecurrence> rule = getCompiled();
+    shared_ptr<RecurrenceGenerator> it = rule->createGenerator(fromDate);
+    if( !it->isValid() ) {
+        pThreadData->mExtraErrorText = str(format("Unable to determine dates. Error: %s") % icalerror_strerror(icalerrno));
+        return ERR_METHOD_FAILED;
+    }
+    
+    // Create list
+    EXTqlist* retList = new EXTqlist(listVlen);
+    str255 colName;
+    qshort dateTimeCol = 0, epochCol = 0, objectCol = 0, colCount = 0;
+    
+    if (withDateTime) {
+        colName = initStr255("OmnisDate");
+        retList->addCol(fftDate,dpFdtimeC,0,&colName);
+        dateTimeCol = ++colCount;
+    }
+    if (withEpoch) {
+        // Number with no decimal places, so times past 2038 still fit
+        colName = initStr255("Epoch");
+        retList->addCol(fftNumber,0,0,&colName);
+        epochCol = ++colCount;
+    }
+    if (withObjects) {
+        colName = initStr255("Date");
+        retList->addCol(fftObject,dpDefault,0,&colName);
+        objectCol = ++colCount;
+    }
+    
+    // The dates are in order, so convert them along a table of the zone's offsets
+    ZoneTransitions fromZoneTransitions(fromZone);
+    
+    icaltimetype curDate = it->next();
+    qlong row = 0;
+    EXTfldval colVal;
+    while(!icaltime_is_null_time(curDate) 
+          && (icaltime_is_null_time(toDate) || icaltime_compare(curDate,toDate) <= 0)
+          && row < maxRows) {
+        // New Row
+        retList->insertRow();
+        ++row;
+        
+        // Epoch seconds come from the UTC time
+        if (epochCol) {
+            retList->getColValRef(row, epochCol, colVal, qtrue);
+            colVal.setNum(static_cast<qreal>(icaltime_as_timet(curDate)), 0);
+        }
+        
+        icaltime_set_timezone(&curDate,utcZone);
+        curDate.is_utc = 0;
+        
+        // Convert to timezone of the first date
+        fromZoneTransitions.convertFromUTC(curDate);
+        
+        // Omnis date
+        if (dateTimeCol) {
+            retList->getColValRef(row, dateTimeCol, colVal, qtrue);
+            getEXTFldValFromTimeType(colVal, curDate, qfalse, pThreadData);
+        }
+        
+        // Date object
+        if (objectCol) {
+            retList->getColValRef(row, objectCol, colVal, qtrue);
+            getEXTFldValFromTimeType(colVal, curDate, qtrue, pThreadData);
+        }
+        
+        curDate = it->next();
+    }
+    
+    EXTfldval retVal;
+    retVal.setList(retList,qtrue);
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
+
+// Returns the dates like $expandDates, but as a binary of packed 64-bit UTC epoch seconds in the machine's byte order.
+// If a Duration in seconds is passed (param 3) each start is followed by the duration, for the static $epoch... methods
+// with bPaired set.
+tResult NVObjRecurrence::methodExpandEpochs( tThreadData* pThreadData, qshort pParamCount )
+{
+    icaltimetype fromDate, toDate;
+    icaltimezone* fromZone = 0;
+    qlong maxRows = -1;
+    tResult result = getExpansionRange(pThreadData, fromDate, toDate, fromZone, maxRows);
+    if (result != METHOD_OK) {
+        return result;
+    }
+    if (maxRows < 0) {
+        maxRows = (icaltime_is_null_time(toDate) ? MAX_ROWS : MAX_EXPAND_ROWS);
+    }
+    
+    // Parameter 3: (Optional) Duration
+    qlong duration = 0;
+    bool paired = false;
+    if ( pParamCount >= 3 ) {
+        if ( getParamLong(pThreadData, 3, duration) != qtrue || duration < 0 ) {
+            pThreadData->mExtraErrorText = "Parameter 3, Duration, is unrecognized.  Expected seconds as a positive integer.";
+            return METHOD_FAILED;
+        }
+        paired = true;
+    }
+    
+    // Iterate
+    shared_ptr<CompiledRecurrence> rule = getCompiled();
+    shared_ptr<RecurrenceGenerator> it = rule->createGenerator(fromDate);
+    if( !it->isValid() ) {
+        pThreadData->mExtraErrorText = str(format("Unable to determine dates. Error: %s") % icalerror_strerror(icalerrno));
+        return ERR_METHOD_FAILED;
+    }
+    
+    // The dates are already in UTC, so no zone conversion is needed
+    EpochArray epochs;
+    icaltimetype curDate = it->next();
+    qlong row = 0;
+    while(!icaltime_is_null_time(curDate) 
+          && (icaltime_is_null_time(toDate) || icaltime_compare(curDate,toDate) <= 0)
+          && row < maxRows) {
+        ++row;
+        
+        epochs.push_back(static_cast<tEpoch>(icaltime_as_timet(curDate)));
+        if (paired) {
+            epochs.push_back(static_cast<tEpoch>(duration));
+        }
+        
+        curDate = it->next();
+    }
+    
+    EXTfldval retVal;
+    if (epochs.empty()) {
+        retVal.setEmpty(fftBinary, dpDefault);
+    } else {
+        retVal.setBinary(fftBinary, reinterpret_cast<qbyte*>(&epochs[0]), static_cast<qlong>(epochs.size() * sizeof(tEpoch)));
+    }
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
+
+// Is the rule endless (Neither COUNT nor UNTIL)?
+static bool isEndlessRule(const icalrecurrencetype& rule) {
+    return (rule.count == 0 && icaltime_is_null_time(rule.until));
+}
+
+// Counts the dates from startDate up to and including endDate (All of them for a null endDate, which needs COUNT 
+// or UNTIL) and sets lastDate to the last one.  Rules with one date per period are counted arithmetically, others are 
+// stepped through without keeping the dates.  Returns -1 if libical can't iterate the rule.
+static qlong countOccurrences(const CompiledRecurrence& compiled, const icaltimetype& startDate, const icaltimetype& endDate, icaltimetype& lastDate)
+{
+    const icalrecurrencetype& rule = compiled.getRule();
+    lastDate = icaltime_null_time();
+    
+    if (isArithmeticRule(rule, startDate)) {
+        icaltimetype until = getUntilUTC(rule);
+        icaltimetype end = endDate;
+        if (!icaltime_is_null_time(until) && (icaltime_is_null_time(end) || icaltime_compare(until, end) < 0)) {
+            end = until;
+        }
+        
+        qlong count = rule.count;
+        if (!icaltime_is_null_time(end)) {
+            if (icaltime_compare(end, startDate) < 0) {
+                return 0;
+            }
+            count = countPeriods(rule, startDate, end) + 1;
+            if (rule.count > 0 && count > rule.count) {
+                count = rule.count;
+            }
+        }
+        if (count > 0) {
+            lastDate = addPeriods(rule, startDate, count - 1);
+        }
+        return count;
+    }
+    
+    shared_ptr<RecurrenceGenerator> it = compiled.createGenerator(startDate);
+    if (!it->isValid()) {
+        return -1;
+    }
+    qlong count = 0;
+    for (icaltimetype curDate = it->next(); !icaltime_is_null_time(curDate); curDate = it->next()) {
+        if (!icaltime_is_null_time(endDate) && icaltime_compare(curDate, endDate) > 0)
+            break;
+        lastDate = curDate;
+        ++count;
+    }
+    return count;
+}
+
+// Returns a UTC date from the iterator as a Date object in the time zone of the From date
+static void getEXTFldValFromOccurrence( tThreadData* pThreadData, EXTfldval& retVal, icaltimetype curDate, icaltimezone* fromZone )
+{
+    icaltimezone* utcZone = icaltimezone_get_utc_timezone();
+    icaltime_set_timezone(&curDate,utcZone);
+    curDate.is_utc = 0;
+    ZoneTransitions fromZoneTransitions(fromZone);
+    fromZoneTransitions.convertFromUTC(curDate);
+    
+    getEXTFldValFromTimeType(retVal, curDate, qtrue, pThreadData);
+}
+
+// Returns the number of dates from the From date (param 1) up to the To date (param 2), without building a list
+tResult NVObjRecurrence::methodOccurrenceCount( tThreadData* pThreadData, qshort pParamCount )
+{
+    icaltimetype fromDate, toDate, lastDate;
+    icaltimezone* fromZone = 0;
+    qlong maxRows = -1;
+    tResult result = getExpansionRange(pThreadData, fromDate, toDate, fromZone, maxRows);
+    if (result != METHOD_OK) {
+        return result;
+    }
+    if (maxRows != -1) {
+        pThreadData->mExtraErrorText = "Parameter 2, To Date, is unrecognized.  Expected Date object or Omnis Date.";
+        return METHOD_FAILED;
+    }
+    if (icaltime_is_null_time(toDate) && isEndlessRule(recur)) {
+        pThreadData->mExtraErrorText = "The rule recurs forever.  Pass a To Date or set a count or until date.";
+        return METHOD_FAILED;
+    }
+    
+    qlong count = countOccurrences(*getCompiled(), fromDate, toDate, lastDate);
+    if (count < 0) {
+        pThreadData->mExtraErrorText = str(format("Unable to determine dates. Error: %s") % icalerror_strerror(icalerrno));
+        return ERR_METHOD_FAILED;
+    }
+    
+    EXTfldval retVal;
+    getEXTFldValFromLong(retVal, static_cast<long>(count));
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
+
+// Returns the date that recurs at a position (param 2, from 1) after the From date (param 1)
+tResult NVObjRecurrence::methodNthOccurrence( tThreadData* pThreadData, qshort pParamCount )
+{
+    icaltimetype fromDate, toDate;
+    icaltimezone* fromZone = 0;
+    qlong number = 0;
+    tResult result = getExpansionRange(pThreadData, fromDate, toDate, fromZone, number);
+    if (result != METHOD_OK) {
+        return result;
+    }
+    if (!icaltime_is_null_time(toDate) || number < 1) {
+        pThreadData->mExtraErrorText = "Parameter 2, Number, is unrecognized.  Expected integer of 1 or more.";
+        return METHOD_FAILED;
+    }
+    
+    icaltimetype curDate = icaltime_null_time();
+    if (isArithmeticRule(recur, fromDate)) {
+        icaltimetype until = getUntilUTC(recur);
+        if (recur.count == 0 || number <= recur.count) {
+            curDate = addPeriods(recur, fromDate, number - 1);
+        }
+        if (!icaltime_is_null_time(until) && icaltime_compare(curDate, until) > 0) {
+            curDate = icaltime_null_time();
+        }
+    } else {
+        shared_ptr<CompiledRecurrence> rule = getCompiled();
+        shared_ptr<RecurrenceGenerator> it = rule->createGenerator(fromDate);
+        if (!it->isValid()) {
+            pThreadData->mExtraErrorText = str(format("Unable to determine dates. Error: %s") % icalerror_strerror(icalerrno));
+            return ERR_METHOD_FAILED;
+        }
+        curDate = it->next();
+        for (qlong position = 1; position < number && !icaltime_is_null_time(curDate); ++position) {
+            curDate = it->next();
+        }
+    }
+    
+    EXTfldval retVal;
+    if (icaltime_is_null_time(curDate)) {
+        retVal.setEmpty(fftObject, dpDefault);
+    } else {
+        getEXTFldValFromOccurrence(pThreadData, retVal, curDate, fromZone);
+    }
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
+
+// Returns the last date that recurs from the From date (param 1) up to the To date (param 2)
+tResult NVObjRecurrence::methodLastOccurrence( tThreadData* pThreadData, qshort pParamCount )
+{
+    icaltimetype fromDate, toDate, lastDate;
+    icaltimezone* fromZone = 0;
+    qlong maxRows = -1;
+    tResult result = getExpansionRange(pThreadData, fromDate, toDate, fromZone, maxRows);
+    if (result != METHOD_OK) {
+        return result;
+    }
+    if (maxRows != -1) {
+        pThreadData->mExtraErrorText = "Parameter 2, To Date, is unrecognized.  Expected Date object or Omnis Date.";
+        return METHOD_FAILED;
+    }
+    if (icaltime_is_null_time(toDate) && isEndlessRule(recur)) {
+        pThreadData->mExtraErrorText = "The rule recurs forever.  Pass a To Date or set a count or until date.";
+        return METHOD_FAILED;
+    }
+    
+    if (countOccurrences(*getCompiled(), fromDate, toDate, lastDate) < 0) {
+        pThreadData->mExtraErrorText = str(format("Unable to determine dates. Error: %s") % icalerror_strerror(icalerrno));
+        return ERR_METHOD_FAILED;
+    }
+    
+    EXTfldval retVal;
+    if (icaltime_is_null_time(lastDate)) {
+        retVal.setEmpty(fftObject, dpDefault);
+    } else {
+        getEXTFldValFromOccurrence(pThreadData, retVal, lastDate, fromZone);
+    }
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
+
+// Returns whether a date recurs from the From date (param 1) on the day of the Date (param 2)
+tResult NVObjRecurrence::methodOccursOn( tThreadData* pThreadData, qshort pParamCount )
+{
+    icaltimetype fromDate, dayDate;
+    icaltimezone* fromZone = 0;
+    qlong maxRows = -1;
+    tResult result = getExpansionRange(pThreadData, fromDate, dayDate, fromZone, maxRows);
+    if (result != METHOD_OK) {
+        return result;
+    }
+    if (icaltime_is_null_time(dayDate)) {
+        pThreadData->mExtraErrorText = "Parameter 2, Date, is unrecognized.  Expected Date object or Omnis Date.";
+        return METHOD_FAILED;
+    }
+    
+    // The day in the time zone of the From date, then back to UTC
+    ZoneTransitions fromZoneTransitions(fromZone);
+    dayDate.is_utc = 0;
+    fromZoneTransitions.convertFromUTC(dayDate);
+    icaltimetype dayStart = dayDate, dayEnd;
+    dayStart.hour = dayStart.minute = dayStart.second = 0;
+    dayEnd = dayStart;
+    icaltime_adjust(&dayEnd, 1, 0, 0, 0);
+    fromZoneTransitions.convertToUTC(dayStart);
+    fromZoneTransitions.convertToUTC(dayEnd);
+    
+    // Seek to the day where the rule allows, and stop at the first date past it
+    RecurrenceIterator it(getCompiled()->getRule(), fromDate, dayStart);
+    if (!it.isValid()) {
+        pThreadData->mExtraErrorText = str(format("Unable to determine dates. Error: %s") % icalerror_strerror(icalerrno));
+        return ERR_METHOD_FAILED;
+    }
+    bool occurs = false;
+    for (icaltimetype curDate = it.next(); !icaltime_is_null_time(curDate) && icaltime_compare(curDate, dayEnd) < 0; curDate = it.next()) {
+        if (icaltime_compare(curDate, dayStart) >= 0) {
+            occurs = true;
+            break;
+        }
+    }
+    
+    EXTfldval retVal;
+    getEXTFldValFromBool(retVal, occurs);
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
+
+// Compiles the rule now rather than on first use.  Returns kTrue if the rule has a fast path, or kFalse if it's 
+// generated by libical.
+tResult NVObjRecurrence::methodCompile( tThreadData* pThreadData, qshort pParamCount )
+{
+    EXTfldval retVal;
+    getEXTFldValFromBool(retVal, getCompiled()->getShape() != CompiledRecurrence::SHAPE_GENERIC);
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
+
+// Returns a RecurrenceIterator that pages through the dates from the Start date (param 1)
+tResult NVObjRecurrence::methodIterator( tThreadData* pThreadData, qshort pParamCount )
+{
+    EXTfldval dateVal;
+    icaltimetype startDate;
+    if ( getParamVar(pThreadData, 1, dateVal) != qtrue || !getZonedTimeTypeFromEXTFldVal(pThreadData, dateVal, startDate) ) {
+        pThreadData->mExtraErrorText = "Parameter 1, Start Date, is unrecognized.  Expected Date object.";
+        return METHOD_FAILED;
+    }
+    
+    // Iterate in UTC, like $datesUntil
+    icaltimezone* startZone = const_cast<icaltimezone*>(startDate.zone);
+    ZoneTransitions startZoneTransitions(startZone);
+    startZoneTransitions.convertToUTC(startDate);
+    
+    NVObjRecurrenceIterator* iteratorObj = createNVObj<NVObjRecurrenceIterator>(pThreadData);
+    if (!iteratorObj) {
+        return ERR_METHOD_FAILED;
+    }
+    iteratorObj->start(getCompiled(), startDate, startZone);
+    
+    EXTfldval retVal;
+    getEXTFldValForObj<NVObjRecurrenceIterator>(retVal, iteratorObj);
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
\ No newline at end of file
@@ -0,0 +1,299 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "RecurrenceGenerator.he"
+#include "RecurrenceIterator.he"
+
+#include <boost/smart_ptr/make_shared.hpp>
+
+using namespace iCalTools;
+using boost::shared_ptr;
+using boost::uint32_t;
+
+// Periods searched without finding an occurrence before a generator gives up (400 years, after which the calendar 
+// repeats, so a rule such as the 30th of February never ends up searching forever)
+const static long kMaxEmptyDays = 146097;
+const static long kMaxEmptyMonths = 4800;
+
+const static long kNoDay = -2147483647L;
+
+static bool isEmptyBy(const short* by) {
+    return (by[0] == ICAL_RECURRENCE_ARRAY_MAX);
+}
+
+// 0 = Sunday, to match the weekday mask
+static int getWeekday(long dayNumber) {
+    long weekday = (dayNumber + 4) % 7;
+    return static_cast<int>(weekday < 0 ? weekday + 7 : weekday);
+}
+
+/**************************************************************************************************
+ **                                    GENERATORS                                                **
+ **************************************************************************************************/
+
+// Occurrences of libical's rules, for shapes without a fast path
+class GenericGenerator : public RecurrenceGenerator {
+public:
+    GenericGenerator(const icalrecurrencetype& rule, const icaltimetype& dtstart) : it(rule, dtstart, icaltime_null_time()) 
+    { }
+    
+    virtual bool isValid() { return it.isValid(); }
+    virtual icaltimetype next() { return it.next(); }
+    
+private:
+    RecurrenceIterator it;
+};
+
+// Generates whole days at the time of DTSTART and applies COUNT and UNTIL.  Derived decides the days, through 
+// nextDay(), which returns the next day after the last one or kNoDay.  Called directly rather than through a 
+// virtual, since it runs once per occurrence.
+template<class Derived>
+class DayGenerator : public RecurrenceGenerator {
+public:
+    DayGenerator(const CompiledRecurrence& c, const icaltimetype& dtstart) 
+        : compiled(c), start(dtstart), interval(c.getRule().interval > 0 ? c.getRule().interval : 1), 
+          startDay(getDayNumber(dtstart.year, dtstart.month, dtstart.day)), emitted(0), finished(false)
+    { }
+    
+    virtual icaltimetype next() {
+        if (finished)
+            return icaltime_null_time();
+        
+        // DTSTART first, then the days of the rule after it
+        long day = (emitted == 0 ? startDay : static_cast<Derived*>(this)->nextDay());
+        if (day == kNoDay) {
+            finished = true;
+            return icaltime_null_time();
+        }
+        
+        icaltimetype occurrence = start;
+        getCivilDate(day, occurrence.year, occurrence.month, occurrence.day);
+        
+        const icalrecurrencetype& rule = compiled.getRule();
+        if ((rule.count > 0 && emitted >= rule.count) 
+            || (!icaltime_is_null_time(rule.until) && icaltime_compare(occurrence, rule.until) > 0)) {
+            finished = true;
+            return icaltime_null_time();
+        }
+        ++emitted;
+        return occurrence;
+    }
+    
+protected:
+    const CompiledRecurrence& compiled;
+    icaltimetype start;
+    long interval;
+    long startDay;
+    
+private:
+    long emitted;
+    bool finished;
+};
+
+template<CompiledRecurrence::Shape S>
+class ShapeGenerator;
+
+// WEEKLY;BYDAY=...  Walks the days of every INTERVAL'th week (Starting on WKST) and keeps the weekdays in the mask.
+template<>
+class ShapeGenerator<CompiledRecurrence::SHAPE_WEEKLY_BY_DAY> : public DayGenerator< ShapeGenerator<CompiledRecurrence::SHAPE_WEEKLY_BY_DAY> > {
+public:
+    ShapeGenerator(const CompiledRecurrence& c, const icaltimetype& dtstart) 
+        : DayGenerator< ShapeGenerator<CompiledRecurrence::SHAPE_WEEKLY_BY_DAY> >(c, dtstart), weekdays(c.getMasks().weekdays)
+    {
+        int weekStart = (c.getRule().week_start != ICAL_NO_WEEKDAY ? c.getRule().week_start - 1 : 1);
+        firstDayOfWeek = startDay - (getWeekday(startDay) - weekStart + 7) % 7;
+        dayOfWeek = static_cast<int>(startDay - firstDayOfWeek) + 1;
+    }
+    
+    long nextDay() {
+        for (;;) {
+            for (; dayOfWeek < 7; ++dayOfWeek) {
+                long day = firstDayOfWeek + dayOfWeek;
+                if (weekdays & (1u << getWeekday(day))) {
+                    ++dayOfWeek;
+                    return day;
+                }
+            }
+            firstDayOfWeek += 7 * interval;
+            dayOfWeek = 0;
+        }
+    }
+    
+private:
+    uint32_t weekdays;
+    long firstDayOfWeek;
+    int dayOfWeek;      // Next day of the week to look at
+};
+
+// MONTHLY;BYMONTHDAY=...[;BYMONTH=...]  Takes the days of every INTERVAL'th month from the mask for its length.
+template<>
+class ShapeGenerator<CompiledRecurrence::SHAPE_MONTHLY_BY_MONTH_DAY> : public DayGenerator< ShapeGenerator<CompiledRecurrence::SHAPE_MONTHLY_BY_MONTH_DAY> > {
+public:
+    ShapeGenerator(const CompiledRecurrence& c, const icaltimetype& dtstart) 
+        : DayGenerator< ShapeGenerator<CompiledRecurrence::SHAPE_MONTHLY_BY_MONTH_DAY> >(c, dtstart), 
+          year(dtstart.year), month(dtstart.month), dayOfMonth(dtstart.day), months(c.getMasks().months)
+    { }
+    
+    long nextDay() {
+        for (long emptyMonths = 0; emptyMonths < kMaxEmptyMonths; emptyMonths += interval) {
+            if (!months || (months & (1u << (month - 1)))) {
+                int length = icaltime_days_in_month(month, year);
+                uint32_t days = compiled.getMonthDaysForLength(length) >> dayOfMonth;
+                for (int day = dayOfMonth + 1; days; ++day, days >>= 1) {
+                    if (days & 1u) {
+                        dayOfMonth = day;
+                        return getDayNumber(year, month, day);
+                    }
+                }
+            }
+            
+            // Next month of the rule
+            long nextMonth = month - 1 + interval;
+            year += static_cast<int>(nextMonth / 12);
+            month = static_cast<int>(nextMonth % 12) + 1;
+            dayOfMonth = 0;
+        }
+        return kNoDay;
+    }
+    
+private:
+    int year;
+    int month;
+    int dayOfMonth;     // Last day returned in the month
+    uint32_t months;
+};
+
+// DAILY with BYDAY, BYMONTHDAY and/or BYMONTH.  Steps INTERVAL days and filters each day with the masks.
+template<>
+class ShapeGenerator<CompiledRecurrence::SHAPE_DAILY_FILTERED> : public DayGenerator< ShapeGenerator<CompiledRecurrence::SHAPE_DAILY_FILTERED> > {
+public:
+    ShapeGenerator(const CompiledRecurrence& c, const icaltimetype& dtstart) 
+        : DayGenerator< ShapeGenerator<CompiledRecurrence::SHAPE_DAILY_FILTERED> >(c, dtstart), 
+          lastDay(startDay), masks(c.getMasks())
+    { }
+    
+    long nextDay() {
+        int year, month, day;
+        for (long emptyDays = 0; emptyDays < kMaxEmptyDays; emptyDays += interval) {
+            lastDay += interval;
+            if (masks.weekdays && !(masks.weekdays & (1u << getWeekday(lastDay))))
+                continue;
+            if (!masks.months && !masks.monthDays && !masks.lastMonthDays)
+                return lastDay;
+            
+            getCivilDate(lastDay, year, month, day);
+            if (masks.months && !(masks.months & (1u << (month - 1))))
+                continue;
+            if ((masks.monthDays || masks.lastMonthDays) 
+                && !(compiled.getMonthDaysForLength(icaltime_days_in_month(month, year)) & (1u << (day - 1))))
+                continue;
+            return lastDay;
+        }
+        return kNoDay;
+    }
+    
+private:
+    long lastDay;
+    RecurrenceMasks masks;
+};
+
+/**************************************************************************************************
+ **                                    COMPILE                                                   **
+ **************************************************************************************************/
+
+CompiledRecurrence::CompiledRecurrence(const icalrecurrencetype& r) : rule(r), shape(SHAPE_GENERIC) {
+    masks.weekdays = masks.monthDays = masks.lastMonthDays = masks.months = 0;
+    for (int i = 0; i < 4; i++) {
+        monthDaysByLength[i] = 0;
+    }
+    
+    // Parts without a fast path
+    if (!isEmptyBy(rule.by_second) || !isEmptyBy(rule.by_minute) || !isEmptyBy(rule.by_hour) 
+        || !isEmptyBy(rule.by_year_day) || !isEmptyBy(rule.by_week_no) || !isEmptyBy(rule.by_set_pos)) {
+        return;
+    }
+    
+    for (int i = 0; i < ICAL_BY_DAY_SIZE && rule.by_day[i] != ICAL_RECURRENCE_ARRAY_MAX; i++) {
+        if (icalrecurrencetype_day_position(rule.by_day[i]) != 0)
+            return;
+        masks.weekdays |= 1u << (icalrecurrencetype_day_day_of_week(rule.by_day[i]) - 1);
+    }
+    for (int i = 0; i < ICAL_BY_MONTHDAY_SIZE && rule.by_month_day[i] != ICAL_RECURRENCE_ARRAY_MAX; i++) {
+        short day = rule.by_month_day[i];
+        if (day >= 1 && day <= 31) {
+            masks.monthDays |= 1u << (day - 1);
+        } else if (day <= -1 && day >= -31) {
+            masks.lastMonthDays |= 1u << (-day - 1);
+        } else {
+            return;
+        }
+    }
+    for (int i = 0; i < ICAL_BY_MONTH_SIZE && rule.by_month[i] != ICAL_RECURRENCE_ARRAY_MAX; i++) {
+        short month = rule.by_month[i];
+        if (month < 1 || month > 12)
+            return;
+        masks.months |= 1u << (month - 1);
+    }
+    
+    // Month days for each length of month, so a month is one lookup
+    for (int length = 28; length <= 31; length++) {
+        uint32_t days = masks.monthDays & ((1u << length) - 1);
+        for (int last = 1; last <= length; last++) {
+            if (masks.lastMonthDays & (1u << (last - 1)))
+                days |= 1u << (length - last);
+        }
+        monthDaysByLength[length - 28] = days;
+    }
+    
+    bool hasDays = !isEmptyBy(rule.by_day);
+    bool hasMonthDays = !isEmptyBy(rule.by_month_day);
+    bool hasMonths = !isEmptyBy(rule.by_month);
+    switch (rule.freq) {
+        case ICAL_WEEKLY_RECURRENCE:
+            if (hasDays && !hasMonthDays && !hasMonths)
+                shape = SHAPE_WEEKLY_BY_DAY;
+            break;
+        case ICAL_MONTHLY_RECURRENCE:
+            if (hasMonthDays && !hasDays)
+                shape = SHAPE_MONTHLY_BY_MONTH_DAY;
+            break;
+        case ICAL_DAILY_RECURRENCE:
+            if (hasDays || hasMonthDays || hasMonths)
+                shape = SHAPE_DAILY_FILTERED;
+            break;
+        default:
+            break;
+    }
+}
+
+shared_ptr<RecurrenceGenerator> CompiledRecurrence::createGenerator(const icaltimetype& dtstart) const {
+    switch (shape) {
+        case SHAPE_WEEKLY_BY_DAY:
+            return boost::make_shared< ShapeGenerator<SHAPE_WEEKLY_BY_DAY> >(*this, dtstart);
+        case SHAPE_MONTHLY_BY_MONTH_DAY:
+            return boost::make_shared< ShapeGenerator<SHAPE_MONTHLY_BY_MONTH_DAY> >(*this, dtstart);
+        case SHAPE_DAILY_FILTERED:
+            return boost::make_shared< ShapeGenerator<SHAPE_DAILY_FILTERED> >(*this, dtstart);
+        default:
+            return boost::make_shared<GenericGenerator>(rule, dtstart);
+    }
+}
\ No newline at end of file
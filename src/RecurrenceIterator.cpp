@@ -0,0 +1,238 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "RecurrenceIterator.he"
+
+using namespace iCalTools;
+
+static bool isEmptyBy(const short* by) {
+    return (by[0] == ICAL_RECURRENCE_ARRAY_MAX);
+}
+
+long iCalTools::getDayNumber(int year, int month, int day) {
+    long y = year - (month <= 2 ? 1 : 0);
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long mp = (month + 9) % 12;
+    long doy = (153 * mp + 2) / 5 + day - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void iCalTools::getCivilDate(long dayNumber, int& year, int& month, int& day) {
+    long z = dayNumber + 719468;
+    long era = (z >= 0 ? z : z - 146096) / 146097;
+    long doe = z - era * 146097;
+    long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long mp = (5 * doy + 2) / 153;
+    day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+    month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    year = static_cast<int>(yoe + era * 400 + (month <= 2 ? 1 : 0));
+}
+
+// Local wall clock seconds (libical steps SECONDLY, MINUTELY and HOURLY rules on the wall clock)
+static long long wallSeconds(const icaltimetype& tt) {
+    return static_cast<long long>(getDayNumber(tt.year, tt.month, tt.day)) * 86400 + tt.hour * 3600 + tt.minute * 60 + tt.second;
+}
+
+// No BY parts apart from BYDAY
+static bool hasOnlyByDay(const icalrecurrencetype& rule) {
+    return (isEmptyBy(rule.by_second) && isEmptyBy(rule.by_minute) && isEmptyBy(rule.by_hour) && isEmptyBy(rule.by_month_day) 
+            && isEmptyBy(rule.by_year_day) && isEmptyBy(rule.by_week_no) && isEmptyBy(rule.by_month) && isEmptyBy(rule.by_set_pos));
+}
+
+bool iCalTools::isArithmeticRule(const icalrecurrencetype& rule, const icaltimetype& dtstart) {
+    if (!hasOnlyByDay(rule) || !isEmptyBy(rule.by_day))
+        return false;
+    
+    switch (rule.freq) {
+        case ICAL_SECONDLY_RECURRENCE:
+        case ICAL_MINUTELY_RECURRENCE:
+        case ICAL_HOURLY_RECURRENCE:
+        case ICAL_DAILY_RECURRENCE:
+        case ICAL_WEEKLY_RECURRENCE:
+            return true;
+        case ICAL_MONTHLY_RECURRENCE:
+            // Every month has the day
+            return (dtstart.day <= 28);
+        case ICAL_YEARLY_RECURRENCE:
+            // Every year has the day
+            return !(dtstart.month == 2 && dtstart.day == 29);
+        default:
+            return false;
+    }
+}
+
+bool iCalTools::isSeekableRule(const icalrecurrencetype& rule, const icaltimetype& dtstart) {
+    if (isArithmeticRule(rule, dtstart))
+        return true;
+    
+    // WEEKLY on plain weekdays (Each week has the same occurrences).  With COUNT, how many were skipped depends 
+    // on the first week, so those step.
+    if (rule.freq != ICAL_WEEKLY_RECURRENCE || rule.count != 0 || !hasOnlyByDay(rule))
+        return false;
+    for (int i = 0; i < ICAL_BY_DAY_SIZE && rule.by_day[i] != ICAL_RECURRENCE_ARRAY_MAX; i++) {
+        if (icalrecurrencetype_day_position(rule.by_day[i]) != 0)
+            return false;
+    }
+    return true;
+}
+
+icaltimetype iCalTools::addPeriods(const icalrecurrencetype& rule, const icaltimetype& dtstart, long periods) {
+    icaltimetype result = dtstart;
+    long interval = (rule.interval > 0 ? rule.interval : 1);
+    long long seconds = 0;
+    long days = 0;
+    long months = 0;
+    
+    switch (rule.freq) {
+        case ICAL_SECONDLY_RECURRENCE:
+            seconds = static_cast<long long>(periods) * interval;
+            break;
+        case ICAL_MINUTELY_RECURRENCE:
+            seconds = static_cast<long long>(periods) * interval * 60;
+            break;
+        case ICAL_HOURLY_RECURRENCE:
+            seconds = static_cast<long long>(periods) * interval * 3600;
+            break;
+        case ICAL_DAILY_RECURRENCE:
+            days = periods * interval;
+            break;
+        case ICAL_WEEKLY_RECURRENCE:
+            days = periods * interval * 7;
+            break;
+        case ICAL_MONTHLY_RECURRENCE:
+            months = periods * interval;
+            break;
+        case ICAL_YEARLY_RECURRENCE:
+            months = periods * interval * 12;
+            break;
+        default:
+            break;
+    }
+    
+    if (seconds) {
+        days = static_cast<long>(seconds / 86400);
+        seconds %= 86400;
+    }
+    if (days || seconds) {
+        icaltime_adjust(&result, static_cast<int>(days), 0, 0, static_cast<int>(seconds));
+    }
+    if (months) {
+        long month = result.month - 1 + months;
+        result.year += static_cast<int>(month / 12);
+        result.month = static_cast<int>(month % 12) + 1;
+    }
+    return result;
+}
+
+long iCalTools::countPeriods(const icalrecurrencetype& rule, const icaltimetype& dtstart, const icaltimetype& to) {
+    if (wallSeconds(to) <= wallSeconds(dtstart))
+        return 0;
+    
+    long interval = (rule.interval > 0 ? rule.interval : 1);
+    long periods = 0;
+    
+    // Whole periods by the calendar, which can be one too many when to is earlier in its day, month or year
+    switch (rule.freq) {
+        case ICAL_SECONDLY_RECURRENCE:
+            periods = static_cast<long>((wallSeconds(to) - wallSeconds(dtstart)) / interval);
+            break;
+        case ICAL_MINUTELY_RECURRENCE:
+            periods = static_cast<long>((wallSeconds(to) - wallSeconds(dtstart)) / (60 * interval));
+            break;
+        case ICAL_HOURLY_RECURRENCE:
+            periods = static_cast<long>((wallSeconds(to) - wallSeconds(dtstart)) / (3600 * interval));
+            break;
+        case ICAL_DAILY_RECURRENCE:
+            periods = (getDayNumber(to.year, to.month, to.day) - getDayNumber(dtstart.year, dtstart.month, dtstart.day)) / interval;
+            break;
+        case ICAL_WEEKLY_RECURRENCE:
+            periods = (getDayNumber(to.year, to.month, to.day) - getDayNumber(dtstart.year, dtstart.month, dtstart.day)) / (7 * interval);
+            break;
+        case ICAL_MONTHLY_RECURRENCE:
+            periods = ((to.year * 12 + to.month) - (dtstart.year * 12 + dtstart.month)) / interval;
+            break;
+        case ICAL_YEARLY_RECURRENCE:
+            periods = (to.year - dtstart.year) / interval;
+            break;
+        default:
+            break;
+    }
+    
+    if (periods > 0 && wallSeconds(addPeriods(rule, dtstart, periods)) > wallSeconds(to))
+        --periods;
+    return periods;
+}
+
+RecurrenceIterator::RecurrenceIterator(const icalrecurrencetype& rule, const icaltimetype& dtstart, const icaltimetype& seekTo) 
+    : it(0), start(dtstart), seeked(false), skipStart(false), finished(false)
+{
+    icalrecurrencetype seekRule = rule;
+    
+    if (!icaltime_is_null_time(seekTo) && isSeekableRule(rule, dtstart)) {
+        long periods = countPeriods(rule, dtstart, seekTo);
+        if (periods > 0) {
+            // COUNT includes the occurrences skipped (One per period, since the rule has no BY parts)
+            if (rule.count > 0) {
+                if (periods >= rule.count) {
+                    finished = true;
+                    return;
+                }
+                seekRule.count = rule.count - static_cast<int>(periods);
+            }
+            start = addPeriods(rule, dtstart, periods);
+            seeked = true;
+            
+            // libical returns the start it's given first, even if it's not on one of the BYDAY days
+            if (!isEmptyBy(rule.by_day)) {
+                skipStart = true;
+                int weekday = icaltime_day_of_week(start);
+                for (int i = 0; i < ICAL_BY_DAY_SIZE && rule.by_day[i] != ICAL_RECURRENCE_ARRAY_MAX; i++) {
+                    if (icalrecurrencetype_day_day_of_week(rule.by_day[i]) == weekday)
+                        skipStart = false;
+                }
+            }
+        }
+    }
+    
+    it = icalrecur_iterator_new(seekRule, start);
+}
+
+RecurrenceIterator::~RecurrenceIterator() {
+    if (it)
+        icalrecur_iterator_free(it);
+}
+
+icaltimetype RecurrenceIterator::next() {
+    if (finished || !it)
+        return icaltime_null_time();
+    
+    icaltimetype occurrence = icalrecur_iterator_next(it);
+    if (skipStart) {
+        skipStart = false;
+        if (!icaltime_is_null_time(occurrence) && wallSeconds(occurrence) == wallSeconds(start))
+            occurrence = icalrecur_iterator_next(it);
+    }
+    return occurrence;
+}
\ No newline at end of file
@@ -0,0 +1,418 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <extcomp.he>
+#include "RecurrenceIteratorObj.he"
+#include "Recurrence.he"
+#include "Constants.he"
+#include "iCalTools.he"
+
+#include <boost/format.hpp>
+#include <boost/smart_ptr/make_shared.hpp>
+
+using namespace OmnisTools;
+using namespace iCalTools;
+using namespace LibiCalConstants;
+using boost::shared_ptr;
+using boost::format;
+
+/**************************************************************************************************
+ **                       CONSTRUCTORS / DESTRUCTORS                                             **
+ **************************************************************************************************/
+
+NVObjRecurrenceIterator::NVObjRecurrenceIterator(qobjinst objinst, tThreadData *pThreadData) : NVObjBase(objinst), zone(0), position(0)
+{ 
+    startDate = icaltime_null_time();
+    pending = icaltime_null_time();
+}
+
+NVObjRecurrenceIterator::~NVObjRecurrenceIterator()
+{ }
+
+/**************************************************************************************************
+ **                                    COPY                                                      **
+ **************************************************************************************************/
+
+void NVObjRecurrenceIterator::copy( NVObjRecurrenceIterator* pObj ) {
+    NVObjBase::copy(pObj);
+    
+    // Generators can't be shared, so the copy starts its own and skips the dates already returned
+    if (pObj->generator) {
+        start(pObj->compiled, pObj->startDate, pObj->zone);
+        while (position < pObj->position && !icaltime_is_null_time(pending)) {
+            pending = generator->next();
+            ++position;
+        }
+    } else {
+        compiled.reset();
+        generator.reset();
+        zoneTransitions.reset();
+        startDate = icaltime_null_time();
+        zone = 0;
+        pending = icaltime_null_time();
+        position = 0;
+    }
+}
+
+/**************************************************************************************************
+ **                               METHOD DECLERATION                                             **
+ **************************************************************************************************/
+
+// This is where the resource # of the methods is defined.  In this project is also used as the Unique ID.
+const static qshort cIteratorMethodError      = 18000,
+                    cIteratorMethodInitialize = 18001,
+                    cIteratorMethodNext       = 18002,
+                    cIteratorMethodReset      = 18003;
+
+
+// Table of parameter resources and types.
+// Note that all parameters can be stored in this single table and the array offset can be  
+// passed via the MethodsTable.
+//
+// Columns are:
+// 1) Name of Parameter (Resource #)
+// 2) Return type (fft value)
+// 3) Parameter flags of type EXTD_FLAG_xxxx
+// 4) Extended flags.  Documentation states, "Must be 0"
+ECOparam cIteratorMethodsParamsTable[] = 
+{
+	// $error
+    18800, fftInteger  , 0, 0,
+	18801, fftCharacter, 0, 0,
+	18802, fftCharacter, 0, 0,
+	18803, fftCharacter, 0, 0,
+    // $initialize
+	18804, fftObject,    0, 0,
+	18805, fftObject,    0, 0,
+    // $next
+    18806, fftInteger,   EXTD_FLAG_PARAMOPT, 0,
+    18807, fftConstant,  EXTD_FLAG_PARAMOPT, 0,
+    18808, fftBoolean,   EXTD_FLAG_PARAMOPT, 0
+};
+
+// Table of Methods available
+// Columns are:
+// 1) Unique ID 
+// 2) Name of Method (Resource #)
+// 3) Return Type 
+// 4) # of Parameters
+// 5) Array of Parameter Names (Taken from MethodsParamsTable.  Increments # of parameters past this pointer) 
+// 6) Enum Start (Not sure what this does, 0 = disabled)
+// 7) Enum Stop (Not sure what this does, 0 = disabled)
+ECOmethodEvent cIteratorMethodsTable[] = 
+{
+	cIteratorMethodError,      cIteratorMethodError,      fftNumber, 4, &cIteratorMethodsParamsTable[0], 0, 0,
+	cIteratorMethodInitialize, cIteratorMethodInitialize, fftNone,   2, &cIteratorMethodsParamsTable[4], 0, 0,
+    cIteratorMethodNext,       cIteratorMethodNext,       fftList,   3, &cIteratorMethodsParamsTable[6], 0, 0,
+    cIteratorMethodReset,      cIteratorMethodReset,      fftNone,   0,                              0, 0, 0
+};
+
+// List of methods
+qlong NVObjRecurrenceIterator::returnMethods(tThreadData* pThreadData)
+{
+	const qshort cIteratorMethodCount = sizeof(cIteratorMethodsTable) / sizeof(ECOmethodEvent);
+	
+	return ECOreturnMethods( gInstLib, pThreadData->mEci, &cIteratorMethodsTable[0], cIteratorMethodCount );
+}
+
+/**************************************************************************************************
+ **                                  METHOD CALL                                                 **
+ **************************************************************************************************/
+
+// Call a method
+qlong NVObjRecurrenceIterator::methodCall( tThreadData* pThreadData )
+{
+    tResult result = METHOD_OK;
+	qshort funcId = (qshort)ECOgetId(pThreadData->mEci);
+	qshort paramCount = ECOgetParamCount(pThreadData->mEci);
+    
+    switch( funcId )
+	{
+		case cIteratorMethodError:
+			result = METHOD_OK; // Always return ok to prevent circular call to error.
+			break;
+		case cIteratorMethodInitialize:
+			pThreadData->mCurMethodName = "$initialize";
+			result = methodInitialize(pThreadData, paramCount);
+			break;
+        case cIteratorMethodNext:
+			pThreadData->mCurMethodName = "$next";
+			result = methodNext(pThreadData, paramCount);
+			break;
+        case cIteratorMethodReset:
+			pThreadData->mCurMethodName = "$reset";
+			result = methodReset(pThreadData, paramCount);
+			break;
+	}
+	
+	callErrorMethod(pThreadData, result);
+
+	return 0L;
+}
+
+/**************************************************************************************************
+ **                              PROPERTY DECLERATION                                            **
+ **************************************************************************************************/
+
+// This is where the resource # of the methods is defined.  In this project it is also used as the Unique ID.
+const static qshort cIteratorPropertyPosition  = 18400,
+                    cIteratorPropertyEndOfDates = 18401;
+
+// Table of properties available
+// Columns are:
+// 1) Unique ID 
+// 2) Name of Property (Resource #)
+// 3) Return Type 
+// 4) Flags describing the property
+// 5) Additional Flags describing the property
+// 6) Enum Start (Not sure what this does, 0 = disabled)
+// 7) Enum Stop (Not sure what this does, 0 = disabled)
+ECOproperty cIteratorPropertyTable[] = 
+{
+    cIteratorPropertyPosition,   cIteratorPropertyPosition,   fftInteger, EXTD_FLAG_PROPCUSTOM, 0, 0, 0,
+    cIteratorPropertyEndOfDates, cIteratorPropertyEndOfDates, fftBoolean, EXTD_FLAG_PROPCUSTOM, 0, 0, 0
+};
+
+// List of properties
+qlong NVObjRecurrenceIterator::returnProperties( tThreadData* pThreadData )
+{
+	const qshort propertyCount = sizeof(cIteratorPropertyTable) / sizeof(ECOproperty);
+    
+	return ECOreturnProperties( gInstLib, pThreadData->mEci, &cIteratorPropertyTable[0], propertyCount );
+}
+
+/**************************************************************************************************
+ **                                  PROPERTY CALL                                               **
+ **************************************************************************************************/
+
+// Assignability of properties
+qlong NVObjRecurrenceIterator::canAssignProperty( tThreadData* pThreadData, qlong propID ) {
+	switch (propID) {
+        case cIteratorPropertyPosition:
+        case cIteratorPropertyEndOfDates:
+			return qfalse;
+		default:
+			return qfalse;
+	}
+}
+
+// Method to retrieve a property of the object
+qlong NVObjRecurrenceIterator::getProperty( tThreadData* pThreadData ) 
+{
+	EXTfldval fValReturn;
+    
+    qlong propID = ECOgetId( pThreadData->mEci );
+	switch( propID ) {
+        case cIteratorPropertyPosition:
+            getEXTFldValFromLong(fValReturn, static_cast<long>(position));
+            break;
+        case cIteratorPropertyEndOfDates:
+            getEXTFldValFromBool(fValReturn, icaltime_is_null_time(pending) == 1);
+            break;
+	}
+    
+    ECOaddParam(pThreadData->mEci, &fValReturn); // Return to caller
+
+	return qtrue;
+}
+
+// Method to set a property of the object
+qlong NVObjRecurrenceIterator::setProperty( tThreadData* pThreadData )
+{
+	// Retrieve value to set for property, always in first parameter
+	EXTfldval fVal;
+	if( getParamVar( pThreadData->mEci, 1, fVal) == qfalse ) 
+		return qfalse;
+
+	// Assign to the appropriate property
+	qlong propID = ECOgetId( pThreadData->mEci );
+	switch( propID ) {
+        case cIteratorPropertyPosition:
+        case cIteratorPropertyEndOfDates:
+			break;
+	}
+
+	return 1L;
+}
+
+/**************************************************************************************************
+ **                                 INTERNAL METHODS                                             **
+ **************************************************************************************************/
+
+void NVObjRecurrenceIterator::start(shared_ptr<CompiledRecurrence> rule, const icaltimetype& startAt, icaltimezone* startZone) {
+    compiled = rule;
+    startDate = startAt;
+    zone = startZone;
+    zoneTransitions = boost::make_shared<ZoneTransitions>(zone);
+    position = 0;
+    
+    generator = compiled->createGenerator(startDate);
+    pending = (generator->isValid() ? generator->next() : icaltime_null_time());
+}
+
+/**************************************************************************************************
+ **                                   CUSTOM METHODS                                             **
+ **************************************************************************************************/
+
+// Starts iterating a Recurrence (param 1) from a start date (param 2)
+tResult NVObjRecurrenceIterator::methodInitialize( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    EXTfldval ruleVal, dateVal;
+    
+    // Parameter 1: Recurrence
+    NVObjRecurrence* recurObj = 0;
+    if ( getParamVar(pThreadData, 1, ruleVal) == qtrue ) {
+        recurObj = getObjForEXTfldval<NVObjRecurrence>(pThreadData, ruleVal);
+    }
+    if ( !recurObj ) {
+        pThreadData->mExtraErrorText = "First parameter, rule, is unrecognized.  Expected Recurrence object.";
+        return ERR_BAD_PARAMS;
+	}
+    
+    // Parameter 2: Start date
+    icaltimetype startAt;
+    if ( getParamVar(pThreadData, 2, dateVal) != qtrue || !getZonedTimeTypeFromEXTFldVal(pThreadData, dateVal, startAt) ) {
+        pThreadData->mExtraErrorText = "Second parameter, startDate, is unrecognized.  Expected Omnis date or Date object.";
+        return ERR_BAD_PARAMS;
+    }
+    
+    // Iterate in UTC, like $datesUntil
+    icaltimezone* startZone = const_cast<icaltimezone*>(startAt.zone);
+    ZoneTransitions startZoneTransitions(startZone);
+    startZoneTransitions.convertToUTC(startAt);
+    
+    start(recurObj->getCompiled(), startAt, startZone);
+    if (!generator->isValid()) {
+        pThreadData->mExtraErrorText = str(format("Unable to determine dates. Error: %s") % icalerror_strerror(icalerrno));
+        return ERR_METHOD_FAILED;
+    }
+    
+    return METHOD_DONE_RETURN;
+}
+
+// Returns a list of the next dates (param 1, default 1) like $expandDates, as plain Omnis date-times and/or UTC epoch 
+// seconds (param 2), and Date objects only if asked for (param 3).  Returns an empty list once there are no more.
+tResult NVObjRecurrenceIterator::methodNext( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    if (!generator) {
+        pThreadData->mExtraErrorText = "Object not initialized";
+        return ERR_METHOD_FAILED;
+    }
+    
+    // Parameter 1: (Optional) Number of dates
+    qlong count = 1;
+    if ( pParamCount >= 1 && (getParamLong(pThreadData, 1, count) != qtrue || count < 1) ) {
+        pThreadData->mExtraErrorText = "First parameter, count, is unrecognized.  Expected integer of 1 or more.";
+        return ERR_BAD_PARAMS;
+    }
+    
+    // Parameter 2: (Optional) Columns
+    EXTfldval columnsVal;
+    ExpandColumns columns = EXPAND_DATETIME;
+    if ( pParamCount >= 2 && getParamVar(pThreadData, 2, columnsVal) == qtrue ) {
+        columns = getICalTypeFromEXTFldVal<ExpandColumns>(columnsVal);
+    }
+    bool withDateTime = (columns == EXPAND_DATETIME || columns == EXPAND_DATETIME_EPOCH);
+    bool withEpoch = (columns == EXPAND_EPOCH || columns == EXPAND_DATETIME_EPOCH);
+    
+    // Parameter 3: (Optional) Add a Date object column
+    qbool withObjects = qfalse;
+    if ( pParamCount >= 3 && getParamBool(pThreadData, 3, withObjects) != qtrue ) {
+        pThreadData->mExtraErrorText = "Third parameter, dateObjects, is unrecognized.  Expected boolean.";
+        return ERR_BAD_PARAMS;
+    }
+    
+    // Create list
+    EXTqlist* retList = new EXTqlist(listVlen);
+    str255 colName;
+    qshort dateTimeCol = 0, epochCol = 0, objectCol = 0, colCount = 0;
+    
+    if (withDateTime) {
+        colName = initStr255("OmnisDate");
+        retList->addCol(fftDate,dpFdtimeC,0,&colName);
+        dateTimeCol = ++colCount;
+    }
+    if (withEpoch) {
+        // Number with no decimal places, so times past 2038 still fit
+        colName = initStr255("Epoch");
+        retList->addCol(fftNumber,0,0,&colName);
+        epochCol = ++colCount;
+    }
+    if (withObjects) {
+        colName = initStr255("Date");
+        retList->addCol(fftObject,dpDefault,0,&colName);
+        objectCol = ++colCount;
+    }
+    
+    icaltimezone* utcZone = icaltimezone_get_utc_timezone();
+    EXTfldval colVal;
+    for (qlong row = 1; row <= count && !icaltime_is_null_time(pending); ++row) {
+        icaltimetype curDate = pending;
+        retList->insertRow();
+        
+        // Epoch seconds come from the UTC time
+        if (epochCol) {
+            retList->getColValRef(row, epochCol, colVal, qtrue);
+            colVal.setNum(static_cast<qreal>(icaltime_as_timet(curDate)), 0);
+        }
+        
+        icaltime_set_timezone(&curDate,utcZone);
+        curDate.is_utc = 0;
+        
+        // Convert to timezone of the start date
+        zoneTransitions->convertFromUTC(curDate);
+        
+        // Omnis date
+        if (dateTimeCol) {
+            retList->getColValRef(row, dateTimeCol, colVal, qtrue);
+            getEXTFldValFromTimeType(colVal, curDate, qfalse, pThreadData);
+        }
+        
+        // Date object
+        if (objectCol) {
+            retList->getColValRef(row, objectCol, colVal, qtrue);
+            getEXTFldValFromTimeType(colVal, curDate, qtrue, pThreadData);
+        }
+        
+        ++position;
+        pending = generator->next();
+    }
+    
+    EXTfldval retVal;
+    retVal.setList(retList,qtrue);
+    ECOaddParam(pThreadData->mEci, &retVal);
+    
+    return METHOD_DONE_RETURN;
+}
+
+// Goes back to the start date
+tResult NVObjRecurrenceIterator::methodReset( tThreadData* pThreadData, qshort pParamCount )
+{ 
+    if (!compiled) {
+        pThreadData->mExtraErrorText = "Object not initialized";
+        return ERR_METHOD_FAILED;
+    }
+    
+    start(compiled, startDate, zone);
+    
+    return METHOD_DONE_RETURN;
+}
\ No newline at end of file
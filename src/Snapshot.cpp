@@ -0,0 +1,521 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Snapshot.he"
+#include "ICSWriter.he"
+#include "MappedFile.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <map>
+#include <vector>
+
+using namespace iCalTools;
+using boost::shared_ptr;
+using boost::uint32_t;
+using boost::uint64_t;
+using boost::int64_t;
+
+// Snapshot layout.  Every value is a 32 or 64 bit integer in the byte order of the machine that wrote it, so records
+// can be read straight out of the mapped file.
+//
+//   Header          kHeaderSize bytes at the offsets below
+//   Component tree  Component: kind, property count, child count, properties, children
+//                   Property:  kind, X name, parameter count, parameters, value kind, value encoding, value
+//   String index    Offset of each string within the string data
+//   String data     Null terminated UTF-8 strings.  Everything else refers to strings by their number.
+const static char kSnapshotMagic[8] = { 'O', 'I', 'C', 'A', 'L', 'S', 'N', 'P' };
+const static uint32_t kSnapshotVersion = 1;
+const static uint32_t kByteOrderMark = 0x01020304;
+const static uint32_t kFlagSourceKnown = 0x1;
+const static uint32_t kNoString = 0xFFFFFFFF;
+const static int kMaxComponentDepth = 64;
+
+const static std::size_t kHeaderMagic             = 0,
+                         kHeaderVersion           = 8,
+                         kHeaderByteOrder         = 12,
+                         kHeaderFlags             = 16,
+                         kHeaderStringCount       = 20,
+                         kHeaderSourceSize        = 24,
+                         kHeaderSourceModified    = 32,
+                         kHeaderTreeOffset        = 40,
+                         kHeaderStringIndexOffset = 48,
+                         kHeaderStringDataOffset  = 56,
+                         kHeaderLibicalVersion    = 64,
+                         kLibicalVersionLength    = 16,
+                         kHeaderSize              = 80;
+
+// How a property value is stored
+enum SnapshotValueEncoding {
+    SNAPSHOT_VALUE_NONE    = 0,
+    SNAPSHOT_VALUE_STRING  = 1, // ICS text of the value, read back with icalvalue_new_from_string
+    SNAPSHOT_VALUE_TEXT    = 2, // Unescaped TEXT
+    SNAPSHOT_VALUE_TIME    = 3, // DATE or DATE-TIME: year, month, day, hour, minute, second, is_utc, is_date
+    SNAPSHOT_VALUE_INTEGER = 4
+};
+
+bool iCalTools::getSnapshotSource(const std::string& path, SnapshotSource& source) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+    
+    source.known = true;
+    source.size = static_cast<uint64_t>(info.st_size);
+    source.modified = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
+
+/**************************************************************************************************
+ **                                       WRITING                                                **
+ **************************************************************************************************/
+
+class SnapshotWriter {
+public:
+    SnapshotWriter(FILE* f) : file(f), written(0), error(false) { }
+    
+    void write(const void* data, std::size_t length) {
+        const char* bytes = static_cast<const char*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + length);
+        written += length;
+        if (buffer.size() >= kBufferSize)
+            flush();
+    }
+    
+    void writeU32(uint32_t v) { write(&v, sizeof(v)); }
+    void writeU64(uint64_t v) { write(&v, sizeof(v)); }
+    
+    bool flush() {
+        if (!buffer.empty()) {
+            if (!error && fwrite(&buffer[0], 1, buffer.size(), file) != buffer.size())
+                error = true;
+            buffer.clear();
+        }
+        return !error;
+    }
+    
+    uint64_t position() { return written; }
+    
+    // Number of a string, adding it to the string table the first time it's seen
+    uint32_t intern(const char* str) {
+        if (!str)
+            return kNoString;
+        
+        std::pair<std::map<std::string, uint32_t>::iterator, bool> result = stringIds.insert(std::make_pair(std::string(str), static_cast<uint32_t>(strings.size())));
+        if (result.second)
+            strings.push_back(&result.first->first);
+        return result.first->second;
+    }
+    
+    void writeComponent(icalcomponent* comp) {
+        std::vector<icalproperty*> props;
+        getProperties(comp, props);
+        
+        writeU32(static_cast<uint32_t>(icalcomponent_isa(comp)));
+        writeU32(static_cast<uint32_t>(props.size()));
+        writeU32(static_cast<uint32_t>(icalcomponent_count_components(comp, ICAL_ANY_COMPONENT)));
+        
+        for (std::vector<icalproperty*>::iterator it = props.begin(); it != props.end(); ++it) {
+            writeProperty(*it);
+        }
+        
+        icalcompiter itr = icalcomponent_begin_component(comp, ICAL_ANY_COMPONENT);
+        for (icalcomponent* child = icalcompiter_deref(&itr); child != 0; child = icalcompiter_next(&itr)) {
+            writeComponent(child);
+        }
+    }
+    
+    void writeProperty(icalproperty* prop) {
+        icalproperty_kind kind = icalproperty_isa(prop);
+        writeU32(static_cast<uint32_t>(kind));
+        writeU32(kind == ICAL_X_PROPERTY ? intern(icalproperty_get_x_name(prop)) : kNoString);
+        
+        // Parameters are kept in their ICS form (NAME=value)
+        std::vector<uint32_t> params;
+        for (icalparameter* param = icalproperty_get_first_parameter(prop, ICAL_ANY_PARAMETER); param != 0; param = icalproperty_get_next_parameter(prop, ICAL_ANY_PARAMETER)) {
+            char* paramString = icalparameter_as_ical_string_r(param);
+            if (paramString) {
+                params.push_back(intern(paramString));
+                icalmemory_free_buffer(paramString);
+            }
+        }
+        writeU32(static_cast<uint32_t>(params.size()));
+        for (std::vector<uint32_t>::iterator it = params.begin(); it != params.end(); ++it) {
+            writeU32(*it);
+        }
+        
+        // Value
+        icalvalue* value = icalproperty_get_value(prop);
+        icalvalue_kind valueKind = (value ? icalvalue_isa(value) : ICAL_NO_VALUE);
+        writeU32(static_cast<uint32_t>(valueKind));
+        
+        if (!value) {
+            writeU32(SNAPSHOT_VALUE_NONE);
+            return;
+        }
+        
+        if (valueKind == ICAL_TEXT_VALUE) {
+            writeU32(SNAPSHOT_VALUE_TEXT);
+            writeU32(intern(icalvalue_get_text(value)));
+            return;
+        }
+        
+        if (valueKind == ICAL_INTEGER_VALUE) {
+            writeU32(SNAPSHOT_VALUE_INTEGER);
+            writeU32(static_cast<uint32_t>(icalvalue_get_integer(value)));
+            return;
+        }
+        
+        if (valueKind == ICAL_DATE_VALUE || valueKind == ICAL_DATETIME_VALUE) {
+            icaltimetype tt = (valueKind == ICAL_DATE_VALUE ? icalvalue_get_date(value) : icalvalue_get_datetime(value));
+            
+            // Floating and UTC times are stored decoded.  Times tied to another zone go through the ICS text like any other value.
+            if (tt.zone == 0 || tt.zone == icaltimezone_get_utc_timezone()) {
+                writeU32(SNAPSHOT_VALUE_TIME);
+                writeU32(static_cast<uint32_t>(tt.year));
+                writeU32(static_cast<uint32_t>(tt.month));
+                writeU32(static_cast<uint32_t>(tt.day));
+                writeU32(static_cast<uint32_t>(tt.hour));
+                writeU32(static_cast<uint32_t>(tt.minute));
+                writeU32(static_cast<uint32_t>(tt.second));
+                writeU32(static_cast<uint32_t>(tt.is_utc));
+                writeU32(static_cast<uint32_t>(tt.is_date));
+                return;
+            }
+        }
+        
+        char* valueString = icalvalue_as_ical_string_r(value);
+        writeU32(SNAPSHOT_VALUE_STRING);
+        writeU32(intern(valueString ? valueString : ""));
+        if (valueString)
+            icalmemory_free_buffer(valueString);
+    }
+    
+    void writeStrings() {
+        uint32_t offset = 0;
+        for (std::vector<const std::string*>::iterator it = strings.begin(); it != strings.end(); ++it) {
+            writeU32(offset);
+            offset += static_cast<uint32_t>((*it)->size() + 1);
+        }
+        for (std::vector<const std::string*>::iterator it = strings.begin(); it != strings.end(); ++it) {
+            write((*it)->c_str(), (*it)->size() + 1);
+        }
+    }
+    
+    uint32_t stringCount() { return static_cast<uint32_t>(strings.size()); }
+    
+private:
+    const static std::size_t kBufferSize = 65536;
+    
+    FILE* file;
+    std::vector<char> buffer;
+    uint64_t written;
+    bool error;
+    
+    std::map<std::string, uint32_t> stringIds;
+    std::vector<const std::string*> strings;
+};
+
+static void setHeaderU32(char* header, std::size_t offset, uint32_t v) { memcpy(header + offset, &v, sizeof(v)); }
+static void setHeaderU64(char* header, std::size_t offset, uint64_t v) { memcpy(header + offset, &v, sizeof(v)); }
+
+bool iCalTools::saveSnapshot(icalcomponent* comp, const std::string& path, const SnapshotSource& source) {
+    if (!comp)
+        return false;
+    
+    shared_ptr<FILE> stream(fopen(path.c_str(), "wb"), fclose);
+    if (!stream)
+        return false;
+    
+    // The header is written last, once the offsets are known
+    char header[kHeaderSize];
+    memset(header, 0, sizeof(header));
+    
+    SnapshotWriter writer(stream.get());
+    writer.write(header, sizeof(header));
+    
+    uint64_t treeOffset = writer.position();
+    writer.writeComponent(comp);
+    
+    uint64_t stringIndexOffset = writer.position();
+    uint64_t stringDataOffset = stringIndexOffset + static_cast<uint64_t>(writer.stringCount()) * sizeof(uint32_t);
+    writer.writeStrings();
+    
+    if (!writer.flush())
+        return false;
+    
+    memcpy(header + kHeaderMagic, kSnapshotMagic, sizeof(kSnapshotMagic));
+    setHeaderU32(header, kHeaderVersion, kSnapshotVersion);
+    setHeaderU32(header, kHeaderByteOrder, kByteOrderMark);
+    setHeaderU32(header, kHeaderFlags, (source.known ? kFlagSourceKnown : 0));
+    setHeaderU32(header, kHeaderStringCount, writer.stringCount());
+    setHeaderU64(header, kHeaderSourceSize, source.size);
+    setHeaderU64(header, kHeaderSourceModified, static_cast<uint64_t>(source.modified));
+    setHeaderU64(header, kHeaderTreeOffset, treeOffset);
+    setHeaderU64(header, kHeaderStringIndexOffset, stringIndexOffset);
+    setHeaderU64(header, kHeaderStringDataOffset, stringDataOffset);
+    strncpy(header + kHeaderLibicalVersion, ICAL_VERSION, kLibicalVersionLength - 1);
+    
+    if (fseek(stream.get(), 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), stream.get()) != sizeof(header))
+        return false;
+    
+    return true;
+}
+
+/**************************************************************************************************
+ **                                       READING                                                **
+ **************************************************************************************************/
+
+class SnapshotReader {
+public:
+    SnapshotReader(const char* b, const char* e, const std::vector<const char*>& s) : pos(b), end(e), strings(s), ok(true) { }
+    
+    bool isOK() { return ok; }
+    
+    uint32_t readU32() {
+        uint32_t v = 0;
+        if (!ok || end - pos < static_cast<std::ptrdiff_t>(sizeof(v))) {
+            ok = false;
+            return 0;
+        }
+        memcpy(&v, pos, sizeof(v));
+        pos += sizeof(v);
+        return v;
+    }
+    
+    const char* readString() {
+        uint32_t id = readU32();
+        if (id == kNoString)
+            return 0;
+        if (id >= strings.size()) {
+            ok = false;
+            return 0;
+        }
+        return strings[id];
+    }
+    
+    // Check that a count could fit in what's left (Every record is at least one value), so damage can't cause huge loops
+    bool checkCount(uint32_t count) {
+        if (static_cast<uint64_t>(count) > static_cast<uint64_t>(end - pos) / sizeof(uint32_t))
+            ok = false;
+        return ok;
+    }
+    
+    // Check that a kind read from the snapshot is one libical knows (first to last, inclusive), so it's never 
+    // cast to an enum value that doesn't exist
+    bool checkKind(uint32_t kind, int first, int last) {
+        if (kind < static_cast<uint32_t>(first) || kind > static_cast<uint32_t>(last))
+            ok = false;
+        return ok;
+    }
+    
+    icalcomponent* readComponent(int depth) {
+        uint32_t kindNumber = readU32();
+        uint32_t propCount = readU32();
+        uint32_t childCount = readU32();
+        if (!checkCount(propCount) || !checkCount(childCount) || depth > kMaxComponentDepth 
+            || !checkKind(kindNumber, ICAL_XROOT_COMPONENT, ICAL_XLICMIMEPART_COMPONENT)) 
+        {
+            ok = false;
+            return 0;
+        }
+        
+        icalcomponent* comp = icalcomponent_new(static_cast<icalcomponent_kind>(kindNumber));
+        if (!comp) {
+            ok = false;
+            return 0;
+        }
+        
+        for (uint32_t i = 0; i < propCount && ok; i++) {
+            icalproperty* prop = readProperty();
+            if (prop)
+                icalcomponent_add_property(comp, prop);
+        }
+        
+        for (uint32_t i = 0; i < childCount && ok; i++) {
+            icalcomponent* child = readComponent(depth + 1);
+            if (child)
+                icalcomponent_add_component(comp, child);
+        }
+        
+        if (!ok) {
+            icalcomponent_free(comp);
+            return 0;
+        }
+        
+        return comp;
+    }
+    
+    icalproperty* readProperty() {
+        uint32_t kindNumber = readU32();
+        const char* xName = readString();
+        if (!checkKind(kindNumber, ICAL_ANY_PROPERTY + 1, ICAL_NO_PROPERTY - 1))
+            return 0;
+        
+        icalproperty* prop = icalproperty_new(static_cast<icalproperty_kind>(kindNumber));
+        if (!prop) {
+            ok = false;
+            return 0;
+        }
+        if (xName)
+            icalproperty_set_x_name(prop, xName);
+        
+        uint32_t paramCount = readU32();
+        if (!checkCount(paramCount)) {
+            icalproperty_free(prop);
+            return 0;
+        }
+        for (uint32_t i = 0; i < paramCount && ok; i++) {
+            const char* paramString = readString();
+            icalparameter* param = (paramString ? icalparameter_new_from_string(paramString) : 0);
+            if (param)
+                icalproperty_add_parameter(prop, param);
+        }
+        
+        // ICAL_NO_VALUE is written for a property without a value
+        uint32_t valueKindNumber = readU32();
+        if (!checkKind(valueKindNumber, ICAL_ANY_VALUE + 1, ICAL_NO_VALUE)) {
+            icalproperty_free(prop);
+            return 0;
+        }
+        icalvalue_kind valueKind = static_cast<icalvalue_kind>(valueKindNumber);
+        icalvalue* value = 0;
+        const char* valueString = 0;
+        icaltimetype tt;
+        
+        switch (readU32()) {
+            case SNAPSHOT_VALUE_NONE:
+                break;
+            case SNAPSHOT_VALUE_STRING:
+                valueString = readString();
+                if (ok && valueString)
+                    value = icalvalue_new_from_string(valueKind, valueString);
+                break;
+            case SNAPSHOT_VALUE_TEXT:
+                valueString = readString();
+                if (ok)
+                    value = icalvalue_new_text(valueString ? valueString : "");
+                break;
+            case SNAPSHOT_VALUE_TIME:
+                tt = icaltime_null_time();
+                tt.year = static_cast<int>(readU32());
+                tt.month = static_cast<int>(readU32());
+                tt.day = static_cast<int>(readU32());
+                tt.hour = static_cast<int>(readU32());
+                tt.minute = static_cast<int>(readU32());
+                tt.second = static_cast<int>(readU32());
+                tt.is_utc = static_cast<int>(readU32());
+                tt.is_date = static_cast<int>(readU32());
+                if (tt.is_utc)
+                    tt.zone = icaltimezone_get_utc_timezone();
+                if (ok)
+                    value = (valueKind == ICAL_DATE_VALUE ? icalvalue_new_date(tt) : icalvalue_new_datetime(tt));
+                break;
+            case SNAPSHOT_VALUE_INTEGER:
+                value = icalvalue_new_integer(static_cast<int>(readU32()));
+                break;
+            default:
+                ok = false;
+                break;
+        }
+        
+        if (!ok) {
+            if (value)
+                icalvalue_free(value);
+            icalproperty_free(prop);
+            return 0;
+        }
+        
+        if (value)
+            icalproperty_set_value(prop, value);
+        
+        return prop;
+    }
+    
+private:
+    const char* pos;
+    const char* end;
+    const std::vector<const char*>& strings;
+    bool ok;
+};
+
+static uint32_t getHeaderU32(const char* header, std::size_t offset) { uint32_t v; memcpy(&v, header + offset, sizeof(v)); return v; }
+static uint64_t getHeaderU64(const char* header, std::size_t offset) { uint64_t v; memcpy(&v, header + offset, sizeof(v)); return v; }
+
+icalcomponent* iCalTools::loadSnapshot(const std::string& path, const SnapshotSource& expectedSource) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < kHeaderSize)
+        return 0;
+    
+    const char* data = file.data();
+    uint64_t size = file.size();
+    
+    // Format, version and the libical version that wrote it (Kinds are stored as libical enum values)
+    char libicalVersion[kLibicalVersionLength];
+    memset(libicalVersion, 0, sizeof(libicalVersion));
+    strncpy(libicalVersion, ICAL_VERSION, kLibicalVersionLength - 1);
+    
+    if (memcmp(data + kHeaderMagic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0
+        || getHeaderU32(data, kHeaderVersion) != kSnapshotVersion
+        || getHeaderU32(data, kHeaderByteOrder) != kByteOrderMark
+        || memcmp(data + kHeaderLibicalVersion, libicalVersion, sizeof(libicalVersion)) != 0) {
+        return 0;
+    }
+    
+    // Stale?
+    if (expectedSource.known) {
+        if (!(getHeaderU32(data, kHeaderFlags) & kFlagSourceKnown)
+            || getHeaderU64(data, kHeaderSourceSize) != expectedSource.size
+            || static_cast<int64_t>(getHeaderU64(data, kHeaderSourceModified)) != expectedSource.modified) {
+            return 0;
+        }
+    }
+    
+    // Sections
+    uint32_t stringCount = getHeaderU32(data, kHeaderStringCount);
+    uint64_t treeOffset = getHeaderU64(data, kHeaderTreeOffset);
+    uint64_t stringIndexOffset = getHeaderU64(data, kHeaderStringIndexOffset);
+    uint64_t stringDataOffset = getHeaderU64(data, kHeaderStringDataOffset);
+    if (treeOffset < kHeaderSize || stringIndexOffset < treeOffset || stringDataOffset > size
+        || stringDataOffset - stringIndexOffset != static_cast<uint64_t>(stringCount) * sizeof(uint32_t)) {
+        return 0;
+    }
+    
+    // Strings are used where they are in the mapping
+    const char* stringData = data + stringDataOffset;
+    uint64_t stringDataSize = size - stringDataOffset;
+    std::vector<const char*> strings;
+    strings.reserve(stringCount);
+    for (uint32_t i = 0; i < stringCount; i++) {
+        uint32_t offset = getHeaderU32(data + stringIndexOffset, i * sizeof(uint32_t));
+        if (offset >= stringDataSize || !memchr(stringData + offset, '\0', static_cast<std::size_t>(stringDataSize - offset)))
+            return 0;
+        strings.push_back(stringData + offset);
+    }
+    
+    SnapshotReader reader(data + treeOffset, data + stringIndexOffset, strings);
+    return reader.readComponent(0);
+}
\ No newline at end of file
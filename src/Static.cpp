@@ -24,16 +24,40 @@
 #include "OmnisTools.he"
 #include "Static.he"
 #include "TimeZone.he"
+#include "ExpansionCache.he"
+#include "BatchExpansion.he"
+#include "EpochArray.he"
+#include "ZoneCache.he"
+#include "ZoneDatabase.he"
+#include "ZonePreload.he"
+#include "ZoneTransitions.he"
+#include "Recurrence.he"
+#include "iCalTools.he"
 
 #include "SystemDate.h"
 
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+
+#include <limits>
+#include <map>
+#include <vector>
+
 using namespace OmnisTools;
+using boost::format;
 
 // Define static methods
 const static qshort cStaticMethodSetZoneDirectory     = 20000,
                     cStaticMethodICalErrorString      = 20001,
                     cStaticMethodGetBuiltInTimezones  = 20002,
-                    cStaticMethodGetCurrentTimezone   = 20003;
+                    cStaticMethodGetCurrentTimezone   = 20003,
+                    cStaticMethodExpansionCacheStats  = 20004,
+                    cStaticMethodExpandRules          = 20005,
+                    cStaticMethodEpochIntersect       = 20006,
+                    cStaticMethodEpochUnion           = 20007,
+                    cStaticMethodEpochCount           = 20008,
+                    cStaticMethodPreloadTimezones     = 20009,
+                    cStaticMethodConvertList          = 20010;
 
 // Parameters for Static Methods
 // Columns are:
@@ -44,7 +68,37 @@ const static qshort cStaticMethodSetZoneDirectory     = 20000,
 ECOparam cStaticMethodsParamsTable[] = 
 {
 	// $setZoneDirectory
-    20800, fftCharacter  , 0, 0
+    20800, fftCharacter  , 0, 0,
+    // $getExpansionCacheStats
+    20801, fftBoolean    , EXTD_FLAG_PARAMOPT, 0,
+    // $expandRules
+    20802, fftList       , 0, 0,
+    20803, fftObject     , 0, 0,
+    20804, fftObject     , 0, 0,
+    20805, fftInteger    , EXTD_FLAG_PARAMOPT, 0,
+    // $epochIntersect
+    20806, fftBinary     , 0, 0,
+    20807, fftBinary     , 0, 0,
+    20808, fftBoolean    , EXTD_FLAG_PARAMOPT, 0,
+    // $epochUnion
+    20809, fftBinary     , 0, 0,
+    20810, fftBinary     , 0, 0,
+    20811, fftBoolean    , EXTD_FLAG_PARAMOPT, 0,
+    // $epochCount
+    20812, fftBinary     , 0, 0,
+    20813, fftBoolean    , EXTD_FLAG_PARAMOPT, 0,
+    20814, fftNumber     , EXTD_FLAG_PARAMOPT, 0,
+    20815, fftNumber     , EXTD_FLAG_PARAMOPT, 0,
+    // $preloadTimezones
+    20816, fftList       , 0, 0,
+    20817, fftInteger    , 0, 0,
+    20818, fftInteger    , 0, 0,
+    20819, fftBoolean    , EXTD_FLAG_PARAMOPT, 0,
+    // $convertList
+    20820, fftList       , 0, 0,
+    20821, fftInteger    , 0, 0,
+    20822, fftCharacter  , 0, 0,
+    20823, fftCharacter  , 0, 0
 };
 
 // Table of Methods available
@@ -61,7 +115,14 @@ ECOmethodEvent cStaticMethodsTable[] =
 	cStaticMethodSetZoneDirectory,     cStaticMethodSetZoneDirectory,     fftNone,      1, &cStaticMethodsParamsTable[0], 0, 0,
     cStaticMethodICalErrorString,      cStaticMethodICalErrorString,      fftCharacter, 0,                             0, 0, 0,
     cStaticMethodGetBuiltInTimezones,  cStaticMethodGetBuiltInTimezones,  fftList,      0,                             0, 0, 0,
-    cStaticMethodGetCurrentTimezone,   cStaticMethodGetCurrentTimezone,   fftRow,       0,                             0, 0, 0
+    cStaticMethodGetCurrentTimezone,   cStaticMethodGetCurrentTimezone,   fftRow,       0,                             0, 0, 0,
+    cStaticMethodExpansionCacheStats,  cStaticMethodExpansionCacheStats,  fftRow,       1, &cStaticMethodsParamsTable[1], 0, 0,
+    cStaticMethodExpandRules,          cStaticMethodExpandRules,          fftList,      4, &cStaticMethodsParamsTable[2], 0, 0,
+    cStaticMethodEpochIntersect,       cStaticMethodEpochIntersect,       fftBinary,    3, &cStaticMethodsParamsTable[6], 0, 0,
+    cStaticMethodEpochUnion,           cStaticMethodEpochUnion,           fftBinary,    3, &cStaticMethodsParamsTable[9], 0, 0,
+    cStaticMethodEpochCount,           cStaticMethodEpochCount,           fftInteger,   4, &cStaticMethodsParamsTable[12], 0, 0,
+    cStaticMethodPreloadTimezones,     cStaticMethodPreloadTimezones,     fftInteger,   4, &cStaticMethodsParamsTable[16], 0, 0,
+    cStaticMethodConvertList,          cStaticMethodConvertList,          fftInteger,   4, &cStaticMethodsParamsTable[20], 0, 0
 };
 
 // List of methods in Simple
@@ -89,6 +150,10 @@ void methodStaticSetZoneDirectory(tThreadData* pThreadData, qshort paramCount) {
     
     // Pass to libical
     set_zone_directory( const_cast<char*>(path.c_str()) );  // Directory expected as non-const char*
+    
+    // Use the compiled transitions if the directory has them, and rebuild the zone tables from them
+    iCalTools::ZoneDatabase::loadShared(path);
+    iCalTools::ZoneCache::instance().clear();
 	
 	return;
 }
@@ -235,6 +300,487 @@ void methodStaticCurrentTimezone(tThreadData* pThreadData, qshort paramCount) {
     ECOaddParam(pThreadData->mEci, &retVal);
 }
 
+// Return row with the hit and miss counters of the recurrence expansion cache, and optionally empty it
+void methodStaticExpansionCacheStats(tThreadData* pThreadData, qshort paramCount) {
+    
+    qbool clearCache = qfalse;
+    if ( paramCount >= 1 && getParamBool(pThreadData, 1, clearCache) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, clear, is unrecognized.  Expected boolean.";
+        return;
+    }
+    
+    iCalTools::ExpansionCacheStats stats = iCalTools::ExpansionCache::instance().stats();
+    if (clearCache == qtrue) {
+        iCalTools::ExpansionCache::instance().clear();
+    }
+    
+    EXTqlist* listVal = new EXTqlist(listVlen);  
+    EXTfldval colName, colValue, retVal;
+    
+    // Setup list definition
+    getEXTFldValFromChar(colName, "Hits");
+    listVal->addCol( fftInteger, dpDefault, 0, &colName.getChar(qtrue) );
+    
+    getEXTFldValFromChar(colName, "Misses");
+    listVal->addCol( fftInteger, dpDefault, 0, &colName.getChar(qtrue) );
+    
+    getEXTFldValFromChar(colName, "Evictions");
+    listVal->addCol( fftInteger, dpDefault, 0, &colName.getChar(qtrue) );
+    
+    getEXTFldValFromChar(colName, "Entries");
+    listVal->addCol( fftInteger, dpDefault, 0, &colName.getChar(qtrue) );
+    
+    getEXTFldValFromChar(colName, "Occurrences");
+    listVal->addCol( fftInteger, dpDefault, 0, &colName.getChar(qtrue) );
+    
+    // Insert single row 
+    listVal->insertRow();
+    listVal->getColValRef(1, 1, colValue, qtrue);
+    getEXTFldValFromLong(colValue, static_cast<long>(stats.hits));
+    
+    listVal->getColValRef(1, 2, colValue, qtrue);
+    getEXTFldValFromLong(colValue, static_cast<long>(stats.misses));
+    
+    listVal->getColValRef(1, 3, colValue, qtrue);
+    getEXTFldValFromLong(colValue, static_cast<long>(stats.evictions));
+    
+    listVal->getColValRef(1, 4, colValue, qtrue);
+    getEXTFldValFromLong(colValue, static_cast<long>(stats.entries));
+    
+    listVal->getColValRef(1, 5, colValue, qtrue);
+    getEXTFldValFromLong(colValue, static_cast<long>(stats.occurrences));
+    
+    // Set current line
+    listVal->setCurRow(1);
+    
+    // Return list to caller
+    retVal.setList(listVal, qtrue);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Reads one row of the $expandRules list: rule (Recurrence object or RRULE text), DTSTART (Omnis date or Date object) 
+// and optionally a TZID.  The DTSTART is kept as local time and the zone is looked up here, before any threads start.
+static bool getBatchRule(tThreadData* pThreadData, EXTqlist& listVal, qlong row, iCalTools::BatchRule& batchRule) {
+    EXTfldval colVal;
+    
+    // Rule
+    listVal.getColValRef(row, 1, colVal, qfalse);
+    if (getType(colVal).valType == fftObject || getType(colVal).valType == fftObjref) {
+        NVObjRecurrence* recurObj = getObjForEXTfldval<NVObjRecurrence>(pThreadData, colVal);
+        if (!recurObj) {
+            return false;
+        }
+        batchRule.rule = recurObj->getRecurrence();
+    } else {
+        std::string ruleText = getStringFromEXTFldVal(colVal);
+        batchRule.rule = icalrecurrencetype_from_string(ruleText.c_str());
+    }
+    if (batchRule.rule.freq == ICAL_NO_RECURRENCE) {
+        return false;
+    }
+    
+    // DTSTART
+    listVal.getColValRef(row, 2, colVal, qfalse);
+    if (!iCalTools::getZonedTimeTypeFromEXTFldVal(pThreadData, colVal, batchRule.dtstart)) {
+        return false;
+    }
+    batchRule.zone = const_cast<icaltimezone*>(batchRule.dtstart.zone);
+    if (batchRule.dtstart.is_utc || !batchRule.zone) {
+        batchRule.zone = icaltimezone_get_utc_timezone();
+    }
+    
+    // TZID (Optional) overrides the zone of the DTSTART
+    if (listVal.colCnt() >= 3) {
+        listVal.getColValRef(row, 3, colVal, qfalse);
+        std::string tzid = getStringFromEXTFldVal(colVal);
+        if (!tzid.empty()) {
+            batchRule.zone = icaltimezone_get_builtin_timezone_from_tzid(tzid.c_str());
+            if (!batchRule.zone) {
+                batchRule.zone = icaltimezone_get_builtin_timezone(tzid.c_str());
+            }
+            if (!batchRule.zone) {
+                return false;
+            }
+        }
+    }
+    
+    // The workers iterate in local time, so UNTIL is too and libical never converts it in a zone
+    batchRule.dtstart.zone = 0;
+    batchRule.dtstart.is_utc = 0;
+    if (!icaltime_is_null_time(batchRule.rule.until) && !batchRule.rule.until.is_date) {
+        if (batchRule.rule.until.is_utc) {
+            batchRule.rule.until.zone = icaltimezone_get_utc_timezone();
+        }
+        batchRule.rule.until = iCalTools::convertTimeToZone(batchRule.rule.until, batchRule.zone);
+        batchRule.rule.until.zone = 0;
+        batchRule.rule.until.is_utc = 0;
+    }
+    return true;
+}
+
+// Expand many recurrence rules over one window on a pool of threads.  Returns a list of Row, Start (In the zone of 
+// the rule) and Epoch, sorted by start.
+void methodStaticExpandRules(tThreadData* pThreadData, qshort paramCount) {
+    
+    // Parameter 1: Rules
+    EXTqlist rulesList;
+    if ( getParamList(pThreadData, 1, rulesList) != qtrue || rulesList.colCnt() < 2 ) {
+        pThreadData->mExtraErrorText = "First parameter, rules, is unrecognized.  Expected list of rule, start date and (optional) TZID.";
+        return;
+    }
+    
+    // Parameters 2 and 3: Window
+    EXTfldval dateVal;
+    icaltimetype fromDate, toDate;
+    if ( getParamVar(pThreadData, 2, dateVal) != qtrue || !iCalTools::getZonedTimeTypeFromEXTFldVal(pThreadData, dateVal, fromDate) ) {
+        pThreadData->mExtraErrorText = "Second parameter, fromDate, is unrecognized.  Expected Omnis date or Date object.";
+        return;
+    }
+    if ( getParamVar(pThreadData, 3, dateVal) != qtrue || !iCalTools::getZonedTimeTypeFromEXTFldVal(pThreadData, dateVal, toDate) ) {
+        pThreadData->mExtraErrorText = "Third parameter, toDate, is unrecognized.  Expected Omnis date or Date object.";
+        return;
+    }
+    
+    // Parameter 4: (Optional) Threads
+    qlong threadCount = 0;
+    if ( paramCount >= 4 && (getParamLong(pThreadData, 4, threadCount) != qtrue || threadCount < 0) ) {
+        pThreadData->mExtraErrorText = "Fourth parameter, threads, is unrecognized.  Expected integer of 0 (one per core) or more.";
+        return;
+    }
+    
+    // Read the rules on this thread, since the workers can't touch Omnis data
+    std::vector<iCalTools::BatchRule> rules(rulesList.rowCnt());
+    for (qlong row = 1; row <= rulesList.rowCnt(); ++row) {
+        if (!getBatchRule(pThreadData, rulesList, row, rules[row-1])) {
+            pThreadData->mExtraErrorText = str(format("Row %d of rules is unrecognized.  Expected Recurrence object or RRULE text, Omnis date or Date object, and a known TZID.") % row);
+            return;
+        }
+    }
+    
+    iCalTools::ZoneTransitions fromTransitions(const_cast<icaltimezone*>(fromDate.zone));
+    iCalTools::ZoneTransitions toTransitions(const_cast<icaltimezone*>(toDate.zone));
+    std::vector<iCalTools::BatchOccurrence> occurrences;
+    iCalTools::expandRulesParallel(rules, fromTransitions.asTimet(fromDate), toTransitions.asTimet(toDate), 
+                                   occurrences, static_cast<unsigned int>(threadCount));
+    
+    EXTqlist* listVal = new EXTqlist(listVlen);  
+    EXTfldval colName, colValue, retVal;
+    
+    // Setup list definition
+    getEXTFldValFromChar(colName, "Row");
+    listVal->addCol( fftInteger, dpDefault, 0, &colName.getChar(qtrue) );
+    
+    getEXTFldValFromChar(colName, "Start");
+    listVal->addCol( fftDate, dpFdtimeC, 0, &colName.getChar(qtrue) );
+    
+    // Number with no decimal places, so times past 2038 still fit
+    getEXTFldValFromChar(colName, "Epoch");
+    listVal->addCol( fftNumber, 0, 0, &colName.getChar(qtrue) );
+    
+    std::map< icaltimezone*, boost::shared_ptr<iCalTools::ZoneTransitions> > zones;
+    for (std::size_t x = 0; x < occurrences.size(); ++x) {
+        const iCalTools::BatchRule& batchRule = rules[occurrences[x].row];
+        boost::shared_ptr<iCalTools::ZoneTransitions>& zone = zones[batchRule.zone];
+        if (!zone) {
+            zone = boost::shared_ptr<iCalTools::ZoneTransitions>(new iCalTools::ZoneTransitions(batchRule.zone));
+        }
+        listVal->insertRow();
+        
+        listVal->getColValRef(x+1, 1, colValue, qtrue);
+        getEXTFldValFromLong(colValue, static_cast<long>(occurrences[x].row + 1));
+        
+        listVal->getColValRef(x+1, 2, colValue, qtrue);
+        iCalTools::getEXTFldValFromTimeType(colValue, zone->fromTimet(occurrences[x].start, batchRule.dtstart.is_date));
+        
+        listVal->getColValRef(x+1, 3, colValue, qtrue);
+        colValue.setNum(static_cast<qreal>(occurrences[x].start), 0);
+    }
+    
+    // Return list to caller
+    retVal.setList(listVal, qtrue);
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Reads a packed epoch binary (From $expandEpochs) into epochs.  Fails if the binary isn't a whole number of elements.
+static bool getEpochArray(tThreadData* pThreadData, qshort paramNum, std::size_t stride, iCalTools::EpochArray& epochs) {
+    EXTfldval binVal;
+    if ( getParamVar(pThreadData, paramNum, binVal) != qtrue ) {
+        return false;
+    }
+    
+    qlong binLen = binVal.getBinLen();
+    std::size_t elementSize = stride * sizeof(iCalTools::tEpoch);
+    if ( binLen < 0 || static_cast<std::size_t>(binLen) % elementSize != 0 ) {
+        return false;
+    }
+    
+    epochs.resize(static_cast<std::size_t>(binLen) / sizeof(iCalTools::tEpoch));
+    if (!epochs.empty()) {
+        qlong readLen = 0;
+        binVal.getBinary(binLen, reinterpret_cast<qbyte*>(&epochs[0]), readLen);
+        if (readLen != binLen) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns a packed epoch binary, or an empty binary for no elements
+static void returnEpochArray(tThreadData* pThreadData, iCalTools::EpochArray& epochs) {
+    EXTfldval retVal;
+    if (epochs.empty()) {
+        retVal.setEmpty(fftBinary, dpDefault);
+    } else {
+        retVal.setBinary(fftBinary, reinterpret_cast<qbyte*>(&epochs[0]), static_cast<qlong>(epochs.size() * sizeof(iCalTools::tEpoch)));
+    }
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Reads the two epoch binaries and the paired flag shared by $epochIntersect and $epochUnion
+static bool getEpochArrayPair(tThreadData* pThreadData, qshort paramCount, iCalTools::EpochArray& epochsA, iCalTools::EpochArray& epochsB, std::size_t& stride) {
+    qbool paired = qfalse;
+    if ( paramCount >= 3 && getParamBool(pThreadData, 3, paired) != qtrue ) {
+        pThreadData->mExtraErrorText = "Third parameter, bPaired, is unrecognized.  Expected boolean.";
+        return false;
+    }
+    stride = (paired ? 2 : 1);
+    
+    if ( !getEpochArray(pThreadData, 1, stride, epochsA) ) {
+        pThreadData->mExtraErrorText = "First parameter, epochsA, is unrecognized.  Expected binary of packed epochs from $expandEpochs.";
+        return false;
+    }
+    if ( !getEpochArray(pThreadData, 2, stride, epochsB) ) {
+        pThreadData->mExtraErrorText = "Second parameter, epochsB, is unrecognized.  Expected binary of packed epochs from $expandEpochs.";
+        return false;
+    }
+    return true;
+}
+
+// Returns the elements of epochsA whose start is also in epochsB
+void methodStaticEpochIntersect(tThreadData* pThreadData, qshort paramCount) {
+    iCalTools::EpochArray epochsA, epochsB, result;
+    std::size_t stride;
+    if ( !getEpochArrayPair(pThreadData, paramCount, epochsA, epochsB, stride) ) {
+        return;
+    }
+    
+    iCalTools::intersectEpochs(epochsA, epochsB, stride, result);
+    returnEpochArray(pThreadData, result);
+}
+
+// Returns the elements of epochsA and epochsB merged in order, keeping epochsA's element for a start in both
+void methodStaticEpochUnion(tThreadData* pThreadData, qshort paramCount) {
+    iCalTools::EpochArray epochsA, epochsB, result;
+    std::size_t stride;
+    if ( !getEpochArrayPair(pThreadData, paramCount, epochsA, epochsB, stride) ) {
+        return;
+    }
+    
+    iCalTools::unionEpochs(epochsA, epochsB, stride, result);
+    returnEpochArray(pThreadData, result);
+}
+
+// Returns the number of elements in a packed epoch binary, or of those with a start from fromEpoch up to (not 
+// including) toEpoch
+void methodStaticEpochCount(tThreadData* pThreadData, qshort paramCount) {
+    
+    // Parameter 2: (Optional) Paired
+    qbool paired = qfalse;
+    if ( paramCount >= 2 && getParamBool(pThreadData, 2, paired) != qtrue ) {
+        pThreadData->mExtraErrorText = "Second parameter, bPaired, is unrecognized.  Expected boolean.";
+        return;
+    }
+    std::size_t stride = (paired ? 2 : 1);
+    
+    // Parameter 1: Epochs
+    iCalTools::EpochArray epochs;
+    if ( !getEpochArray(pThreadData, 1, stride, epochs) ) {
+        pThreadData->mExtraErrorText = "First parameter, epochs, is unrecognized.  Expected binary of packed epochs from $expandEpochs.";
+        return;
+    }
+    
+    // Parameters 3 and 4: (Optional) Range
+    EXTfldval epochVal;
+    iCalTools::tEpoch fromEpoch = std::numeric_limits<iCalTools::tEpoch>::min(), toEpoch = std::numeric_limits<iCalTools::tEpoch>::max();
+    if ( paramCount >= 3 ) {
+        if ( getParamVar(pThreadData, 3, epochVal) != qtrue ) {
+            pThreadData->mExtraErrorText = "Third parameter, fromEpoch, is unrecognized.  Expected number.";
+            return;
+        }
+        fromEpoch = static_cast<iCalTools::tEpoch>(getDoubleFromEXTFldVal(epochVal));
+    }
+    if ( paramCount >= 4 ) {
+        if ( getParamVar(pThreadData, 4, epochVal) != qtrue ) {
+            pThreadData->mExtraErrorText = "Fourth parameter, toEpoch, is unrecognized.  Expected number.";
+            return;
+        }
+        toEpoch = static_cast<iCalTools::tEpoch>(getDoubleFromEXTFldVal(epochVal));
+    }
+    
+    EXTfldval retVal;
+    getEXTFldValFromLong(retVal, static_cast<long>(iCalTools::countEpochs(epochs, stride, fromEpoch, toEpoch)));
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Years $preloadTimezones will expand zones through
+const static qlong kMaxPreloadYear = 2100;
+
+// Loads and expands time zones ahead of use, on this thread or in the background.  Returns the number of zones.
+void methodStaticPreloadTimezones(tThreadData* pThreadData, qshort paramCount) {
+    
+    // Parameter 1: List of TZIDs (First column), a TZID, or "all"
+    EXTfldval zonesVal;
+    std::vector<std::string> tzids;
+    if ( getParamVar(pThreadData, 1, zonesVal) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, zones, is unrecognized.  Expected list of TZIDs or 'all'.";
+        return;
+    }
+    if ( isList(zonesVal, qtrue) == qtrue ) {
+        EXTqlist zonesList;
+        zonesVal.getList(&zonesList, qfalse);
+        EXTfldval colVal;
+        for (qlong row = 1; row <= zonesList.rowCnt(); ++row) {
+            zonesList.getColValRef(row, 1, colVal, qfalse);
+            std::string tzid = getStringFromEXTFldVal(colVal);
+            if (!tzid.empty()) {
+                tzids.push_back(tzid);
+            }
+        }
+        if (tzids.empty()) {
+            pThreadData->mExtraErrorText = "First parameter, zones, has no TZIDs.  Pass 'all' to preload every zone.";
+            return;
+        }
+    } else {
+        std::string tzid = getStringFromEXTFldVal(zonesVal);
+        if (tzid.empty()) {
+            pThreadData->mExtraErrorText = "First parameter, zones, is unrecognized.  Expected list of TZIDs or 'all'.";
+            return;
+        }
+        if (!boost::iequals(tzid, "all")) {
+            tzids.push_back(tzid);
+        }
+    }
+    
+    // Parameters 2 and 3: Years
+    qlong fromYear, toYear;
+    if ( getParamLong(pThreadData, 2, fromYear) != qtrue || fromYear < 1 ) {
+        pThreadData->mExtraErrorText = "Second parameter, fromYear, is unrecognized.  Expected year.";
+        return;
+    }
+    if ( getParamLong(pThreadData, 3, toYear) != qtrue || toYear < fromYear || toYear > kMaxPreloadYear ) {
+        pThreadData->mExtraErrorText = str(format("Third parameter, toYear, is unrecognized.  Expected year from fromYear to %d.") % kMaxPreloadYear);
+        return;
+    }
+    
+    // Parameter 4: (Optional) Background
+    qbool background = qfalse;
+    if ( paramCount >= 4 && getParamBool(pThreadData, 4, background) != qtrue ) {
+        pThreadData->mExtraErrorText = "Fourth parameter, bBackground, is unrecognized.  Expected boolean.";
+        return;
+    }
+    
+    std::vector<icaltimezone*> zones;
+    std::string unknown;
+    if ( !iCalTools::getPreloadZones(tzids, zones, unknown) ) {
+        pThreadData->mExtraErrorText = str(format("Unknown time zone '%s'.  Expected a built-in TZID or location.") % unknown);
+        return;
+    }
+    
+    if (background) {
+        iCalTools::ZoneWarmup::start(zones, static_cast<int>(fromYear), static_cast<int>(toYear));
+    } else {
+        iCalTools::preloadZones(zones, static_cast<int>(fromYear), static_cast<int>(toYear));
+    }
+    
+    EXTfldval retVal;
+    getEXTFldValFromLong(retVal, static_cast<long>(zones.size()));
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
+// Built-in zone for a TZID or location, or UTC
+static icaltimezone* getZoneFromTZID(const std::string& tzid) {
+    if (boost::iequals(tzid, "UTC")) {
+        return icaltimezone_get_utc_timezone();
+    }
+    icaltimezone* zone = icaltimezone_get_builtin_timezone_from_tzid(tzid.c_str());
+    if (!zone) {
+        zone = icaltimezone_get_builtin_timezone(tzid.c_str());
+    }
+    return zone;
+}
+
+// Converts a date time column of a list from one zone to another, in place.  One set of transitions is kept for each 
+// zone, so sorted dates find their offsets without searching.  Returns the number of dates converted.
+void methodStaticConvertList(tThreadData* pThreadData, qshort paramCount) {
+    
+    // Parameter 1: List
+    EXTqlist listVal;
+    if ( getParamList(pThreadData, 1, listVal) != qtrue ) {
+        pThreadData->mExtraErrorText = "First parameter, list, is unrecognized.  Expected list.";
+        return;
+    }
+    
+    // Parameter 2: Column
+    qlong column;
+    if ( getParamLong(pThreadData, 2, column) != qtrue || column < 1 || column > listVal.colCnt() ) {
+        pThreadData->mExtraErrorText = "Second parameter, column, is unrecognized.  Expected column number of the list.";
+        return;
+    }
+    
+    // Parameters 3 and 4: Zones
+    EXTfldval zoneVal;
+    icaltimezone* fromZone = 0;
+    icaltimezone* toZone = 0;
+    if ( getParamVar(pThreadData, 3, zoneVal) != qtrue || !(fromZone = getZoneFromTZID(getStringFromEXTFldVal(zoneVal))) ) {
+        pThreadData->mExtraErrorText = "Third parameter, fromTZID, is unrecognized.  Expected a built-in TZID or location.";
+        return;
+    }
+    if ( getParamVar(pThreadData, 4, zoneVal) != qtrue || !(toZone = getZoneFromTZID(getStringFromEXTFldVal(zoneVal))) ) {
+        pThreadData->mExtraErrorText = "Fourth parameter, toTZID, is unrecognized.  Expected a built-in TZID or location.";
+        return;
+    }
+    
+    qlong converted = 0;
+    if (fromZone != toZone) {
+        iCalTools::ZoneTransitions fromTransitions(fromZone);
+        iCalTools::ZoneTransitions toTransitions(toZone);
+        
+        EXTfldval colVal;
+        for (qlong row = 1; row <= listVal.rowCnt(); ++row) {
+            listVal.getColValRef(row, static_cast<qshort>(column), colVal, qtrue);
+            if (getType(colVal).valType != fftDate || colVal.isNull() == qtrue || colVal.isEmpty() == qtrue) {
+                continue;
+            }
+            
+            // Dates without a time have no zone to convert.  Times repeated when clocks go back are standard time.
+            icaltimetype cell = iCalTools::getTimeTypeFromEXTFldVal(pThreadData, colVal);
+            icaltimetype tt = icaltime_null_time();
+            tt.year = cell.year;
+            tt.month = cell.month;
+            tt.day = cell.day;
+            tt.hour = cell.hour;
+            tt.minute = cell.minute;
+            tt.second = cell.second;
+            tt.is_date = cell.is_date;
+            tt.is_daylight = 0;
+            if (tt.is_date || !icaltime_is_valid_time(tt)) {
+                continue;
+            }
+            
+            fromTransitions.convertToUTC(tt);
+            toTransitions.convertFromUTC(tt);
+            iCalTools::getEXTFldValFromTimeType(colVal, tt);
+            ++converted;
+        }
+    }
+    
+    ECOsetParameterChanged(pThreadData->mEci, 1);  // Mark the list as changed
+    
+    EXTfldval retVal;
+    getEXTFldValFromLong(retVal, static_cast<long>(converted));
+    ECOaddParam(pThreadData->mEci, &retVal);
+}
+
 // Static method dispatch
 qlong staticMethodCall( OmnisTools::tThreadData* pThreadData ) {
 	
@@ -259,6 +805,34 @@ qlong staticMethodCall( OmnisTools::tThreadData* pThreadData ) {
 			pThreadData->mCurMethodName = "$getCurrentTimezone";
 			methodStaticCurrentTimezone(pThreadData, paramCount);
 			break;
+        case cStaticMethodExpansionCacheStats:
+			pThreadData->mCurMethodName = "$getExpansionCacheStats";
+			methodStaticExpansionCacheStats(pThreadData, paramCount);
+			break;
+        case cStaticMethodExpandRules:
+			pThreadData->mCurMethodName = "$expandRules";
+			methodStaticExpandRules(pThreadData, paramCount);
+			break;
+        case cStaticMethodEpochIntersect:
+			pThreadData->mCurMethodName = "$epochIntersect";
+			methodStaticEpochIntersect(pThreadData, paramCount);
+			break;
+        case cStaticMethodEpochUnion:
+			pThreadData->mCurMethodName = "$epochUnion";
+			methodStaticEpochUnion(pThreadData, paramCount);
+			break;
+        case cStaticMethodEpochCount:
+			pThreadData->mCurMethodName = "$epochCount";
+			methodStaticEpochCount(pThreadData, paramCount);
+			break;
+        case cStaticMethodPreloadTimezones:
+			pThreadData->mCurMethodName = "$preloadTimezones";
+			methodStaticPreloadTimezones(pThreadData, paramCount);
+			break;
+        case cStaticMethodConvertList:
+			pThreadData->mCurMethodName = "$convertList";
+			methodStaticConvertList(pThreadData, paramCount);
+			break;
 	}
 	
 	return 0L;
@@ -0,0 +1,65 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "SystemDate.h"
+
+#include <boost/thread/mutex.hpp>
+
+#include <ctime>
+
+// Process-wide copy of the system zone.  Constructed when the library loads, before any thread can use it.
+static boost::mutex cacheMutex;
+static bool cacheValid = false;
+static std::string cachedName;
+static bool cachedDaylight = false;
+static std::string cachedStamp;
+static time_t stampCheckedAt = 0;
+static time_t queriedAt = 0;
+
+// Daylight time starts and ends on the minute, so the zone is asked for again in each new minute
+const static time_t kQuerySeconds = 60;
+
+SystemTimeZone::SystemTimeZone() {
+    time_t now = time(0);
+    boost::mutex::scoped_lock lock(cacheMutex);
+    
+    // The setting is checked at most once a second
+    if (!cacheValid || now != stampCheckedAt) {
+        std::string stamp = changeStamp();
+        stampCheckedAt = now;
+        if (stamp != cachedStamp) {
+            cachedStamp = stamp;
+            cacheValid = false;
+        }
+    }
+    
+    if (!cacheValid || now / kQuerySeconds != queriedAt / kQuerySeconds) {
+        query(cachedName, cachedDaylight);
+        queriedAt = now;
+        cacheValid = true;
+    }
+    
+    _name = cachedName;
+    _isDaylight = cachedDaylight;
+}
+
+SystemTimeZone::~SystemTimeZone() { }
\ No newline at end of file
@@ -0,0 +1,234 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "ZoneCache.he"
+#include "ZoneDatabase.he"
+#include "ZoneTransitions.he"
+
+#include <limits>
+#include <set>
+
+using namespace iCalTools;
+
+ZoneTable::ZoneTable(time_t f, time_t u, std::vector<ZoneTransition>& t) : from(f), until(u) {
+    transitions.swap(t);
+}
+
+std::size_t ZoneTable::find(time_t utc, std::size_t hint) const {
+    std::size_t low = 0, high = transitions.size();
+    if (hint < high && transitions[hint].start <= utc) {
+        // Times that increase usually stay in the same transition
+        if (hint + 1 == high || transitions[hint + 1].start > utc) {
+            return hint;
+        }
+        low = hint + 1;
+    }
+    while (high - low > 1) {
+        std::size_t middle = low + (high - low) / 2;
+        if (transitions[middle].start <= utc) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Local time at which a change happens: the earlier of its local times before and after, so skipped times are after 
+// it and repeated times are too
+static time_t getChangeLocal(const std::vector<ZoneTransition>& transitions, std::size_t index) {
+    const ZoneTransition& change = transitions[index];
+    int previousOffset = transitions[index - 1].offset;
+    return change.start + (change.offset < previousOffset ? change.offset : previousOffset);
+}
+
+bool ZoneTable::getUTC(time_t local, bool isDaylight, time_t& utc, std::size_t& hint) const {
+    // Last change at or before the local time
+    std::size_t low = 0, high = transitions.size();
+    if (hint < high && (hint == 0 || getChangeLocal(transitions, hint) <= local)) {
+        // Times that increase usually stay after the same change
+        if (hint + 1 == high || getChangeLocal(transitions, hint + 1) > local) {
+            low = high = hint;
+        } else {
+            low = hint + 1;
+        }
+    }
+    while (high - low > 1) {
+        std::size_t middle = low + (high - low) / 2;
+        if (getChangeLocal(transitions, middle) <= local) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    hint = low;
+    
+    // A repeated time asked for in daylight time is before the change
+    if (isDaylight && low > 0) {
+        const ZoneTransition& change = transitions[low];
+        const ZoneTransition& previous = transitions[low - 1];
+        if (change.offset < previous.offset && previous.isDaylight && local < change.start + previous.offset) {
+            --low;
+        }
+    }
+    
+    utc = local - transitions[low].offset;
+    return covers(utc);
+}
+
+// Constructed when the library loads, before any thread can use them
+ZoneCache ZoneCache::sharedCache;
+boost::recursive_mutex ZoneCache::sharedLibicalLock;
+
+ZoneCache::ZoneCache() 
+{ }
+
+ZoneCache& ZoneCache::instance() {
+    return sharedCache;
+}
+
+boost::recursive_mutex& ZoneCache::libicalLock() {
+    return sharedLibicalLock;
+}
+
+boost::shared_ptr<const ZoneTable> ZoneCache::getTable(icaltimezone* zone) {
+    if (!zone || zone == icaltimezone_get_utc_timezone()) {
+        return boost::shared_ptr<const ZoneTable>();
+    }
+    
+    {
+        boost::shared_lock<boost::shared_mutex> reader(lock);
+        TableMap::iterator it = tables.find(zone);
+        if (it != tables.end()) {
+            return it->second;
+        }
+        CalendarTableMap::iterator calendarIt = calendarTables.find(zone);
+        if (calendarIt != calendarTables.end() && isSameZone(zone, calendarIt->second)) {
+            return calendarIt->second.table;
+        }
+    }
+    
+    // Check again, since another thread may have built it before the lock was taken
+    boost::unique_lock<boost::shared_mutex> writer(lock);
+    TableMap::iterator it = tables.find(zone);
+    if (it != tables.end()) {
+        return it->second;
+    }
+    CalendarTableMap::iterator calendarIt = calendarTables.find(zone);
+    if (calendarIt != calendarTables.end() && isSameZone(zone, calendarIt->second)) {
+        return calendarIt->second.table;
+    }
+    
+    boost::recursive_mutex::scoped_lock libical(sharedLibicalLock);
+    const char* location = icaltimezone_get_location(zone);
+    if (location && icaltimezone_get_builtin_timezone(location) == zone) {
+        boost::shared_ptr<const ZoneTable> table = buildTable(zone, location);
+        tables[zone] = table;
+        return table;
+    }
+    
+    CalendarTable& calendarTable = calendarTables[zone];
+    calendarTable.table = ZoneTransitions::compileTable(zone);
+    calendarTable.vtimezone = icaltimezone_get_component(zone);
+    const char* tzid = icaltimezone_get_tzid(zone);
+    calendarTable.tzid = (tzid ? tzid : "");
+    return calendarTable.table;
+}
+
+// A calendar zone's address may have been reused by a zone from another calendar since its table was built
+bool ZoneCache::isSameZone(icaltimezone* zone, const CalendarTable& calendarTable) {
+    boost::recursive_mutex::scoped_lock libical(sharedLibicalLock);
+    const char* tzid = icaltimezone_get_tzid(zone);
+    return (icaltimezone_get_component(zone) == calendarTable.vtimezone && calendarTable.tzid == (tzid ? tzid : ""));
+}
+
+void ZoneCache::clear() {
+    boost::unique_lock<boost::shared_mutex> writer(lock);
+    tables.clear();
+    calendarTables.clear();
+}
+
+void ZoneCache::forgetZones(icalcomponent* comp) {
+    if (!comp) {
+        return;
+    }
+    
+    std::set<icalcomponent*> vtimezones;
+    if (icalcomponent_isa(comp) == ICAL_VTIMEZONE_COMPONENT) {
+        vtimezones.insert(comp);
+    }
+    for (icalcomponent* child = icalcomponent_get_first_component(comp, ICAL_VTIMEZONE_COMPONENT);
+         child != 0;
+         child = icalcomponent_get_next_component(comp, ICAL_VTIMEZONE_COMPONENT)) 
+    {
+        vtimezones.insert(child);
+    }
+    if (vtimezones.empty()) {
+        return;
+    }
+    
+    boost::unique_lock<boost::shared_mutex> writer(lock);
+    for (CalendarTableMap::iterator it = calendarTables.begin(); it != calendarTables.end(); ) {
+        if (vtimezones.count(it->second.vtimezone)) {
+            calendarTables.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Built-in zones, from the compiled zone database if it has them or else from their observances
+boost::shared_ptr<const ZoneTable> ZoneCache::buildTable(icaltimezone* zone, const char* location) {
+    std::vector<ZoneTransition> transitions;
+    boost::shared_ptr<ZoneDatabase> database = ZoneDatabase::shared();
+    const ZoneDatabaseZone* databaseZone = (database ? database->findZone(location) : 0);
+    if (databaseZone) {
+        // The first transition starts before any time.  Transitions past the range of time_t are dropped.
+        time_t from = std::numeric_limits<time_t>::min();
+        time_t until = std::numeric_limits<time_t>::max();
+        if (database->coveredUntil() < static_cast<boost::int64_t>(until)) {
+            until = static_cast<time_t>(database->coveredUntil());
+        }
+        
+        const ZoneDatabaseTransition* first = database->getTransitions(databaseZone);
+        for (boost::uint32_t x = 0; x < databaseZone->transitionCount; ++x) {
+            if (x > 0 && first[x].start >= static_cast<boost::int64_t>(until)) {
+                break;
+            }
+            ZoneTransition transition;
+            transition.start = from;
+            transition.offset = first[x].offset;
+            transition.isDaylight = first[x].isDaylight;
+            if (x > 0 && first[x].start > static_cast<boost::int64_t>(from)) {
+                transition.start = static_cast<time_t>(first[x].start);
+                transitions.push_back(transition);
+            } else if (x > 0) {
+                transitions.back() = transition;
+            } else {
+                transitions.push_back(transition);
+            }
+        }
+        return boost::shared_ptr<const ZoneTable>(new ZoneTable(from, until, transitions));
+    }
+    
+    return ZoneTransitions::compileTable(zone);
+}
\ No newline at end of file
@@ -0,0 +1,169 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "ZoneDatabase.he"
+
+#include <cstring>
+
+using namespace iCalTools;
+
+// Name of the compiled database in the zone directory, beside zones.tab
+const static char* kZoneDatabaseFile = "zones.bin";
+
+boost::mutex ZoneDatabase::sharedLock;
+boost::shared_ptr<ZoneDatabase> ZoneDatabase::sharedDatabase;
+
+ZoneDatabase::ZoneDatabase() : header(0), transitions(0), zones(0), abbreviations(0), strings(0) 
+{ }
+
+// Does a section of count records fit in the file?
+static bool isInFile(boost::uint64_t offset, boost::uint64_t count, boost::uint64_t recordSize, std::size_t fileSize) {
+    return (offset <= fileSize && count * recordSize <= fileSize - offset);
+}
+
+bool ZoneDatabase::open(const std::string& path) {
+    header = 0;
+    if (!file.open(path) || file.size() < sizeof(ZoneDatabaseHeader)) {
+        file.close();
+        return false;
+    }
+    
+    const char* data = file.data();
+    const ZoneDatabaseHeader* fileHeader = reinterpret_cast<const ZoneDatabaseHeader*>(data);
+    if (std::memcmp(fileHeader->magic, kZoneDatabaseMagic, sizeof(kZoneDatabaseMagic)) != 0
+        || fileHeader->byteOrder != kZoneDatabaseByteOrder
+        || fileHeader->version != kZoneDatabaseVersion
+        || fileHeader->transitionsOffset % sizeof(boost::int64_t) != 0
+        || fileHeader->zonesOffset % sizeof(boost::uint32_t) != 0
+        || fileHeader->abbreviationsOffset % sizeof(boost::uint32_t) != 0
+        || !isInFile(fileHeader->transitionsOffset, fileHeader->transitionCount, sizeof(ZoneDatabaseTransition), file.size())
+        || !isInFile(fileHeader->zonesOffset, fileHeader->zoneCount, sizeof(ZoneDatabaseZone), file.size())
+        || !isInFile(fileHeader->abbreviationsOffset, fileHeader->abbreviationCount, sizeof(boost::uint32_t), file.size())
+        || !isInFile(fileHeader->stringsOffset, fileHeader->stringsSize, 1, file.size())
+        || fileHeader->stringsSize == 0
+        || data[fileHeader->stringsOffset + fileHeader->stringsSize - 1] != '\0') 
+    {
+        file.close();
+        return false;
+    }
+    
+    const ZoneDatabaseTransition* fileTransitions = reinterpret_cast<const ZoneDatabaseTransition*>(data + fileHeader->transitionsOffset);
+    const ZoneDatabaseZone* fileZones = reinterpret_cast<const ZoneDatabaseZone*>(data + fileHeader->zonesOffset);
+    const boost::uint32_t* fileAbbreviations = reinterpret_cast<const boost::uint32_t*>(data + fileHeader->abbreviationsOffset);
+    
+    // Check the references, so lookups don't have to
+    for (boost::uint32_t x = 0; x < fileHeader->zoneCount; ++x) {
+        const ZoneDatabaseZone& zone = fileZones[x];
+        if (zone.location >= fileHeader->stringsSize
+            || zone.transitionCount == 0
+            || zone.firstTransition > fileHeader->transitionCount
+            || zone.transitionCount > fileHeader->transitionCount - zone.firstTransition) 
+        {
+            file.close();
+            return false;
+        }
+    }
+    for (boost::uint32_t x = 0; x < fileHeader->abbreviationCount; ++x) {
+        if (fileAbbreviations[x] >= fileHeader->stringsSize) {
+            file.close();
+            return false;
+        }
+    }
+    for (boost::uint32_t x = 0; x < fileHeader->transitionCount; ++x) {
+        if (fileTransitions[x].abbreviation >= fileHeader->abbreviationCount) {
+            file.close();
+            return false;
+        }
+    }
+    
+    header = fileHeader;
+    transitions = fileTransitions;
+    zones = fileZones;
+    abbreviations = fileAbbreviations;
+    strings = data + fileHeader->stringsOffset;
+    
+    return true;
+}
+
+const ZoneDatabaseZone* ZoneDatabase::findZone(const char* location) const {
+    if (!header || !location) {
+        return 0;
+    }
+    
+    std::size_t low = 0, high = header->zoneCount;
+    while (low < high) {
+        std::size_t middle = low + (high - low) / 2;
+        int compare = std::strcmp(strings + zones[middle].location, location);
+        if (compare == 0) {
+            return &zones[middle];
+        } else if (compare < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return 0;
+}
+
+bool ZoneDatabase::getOffset(const ZoneDatabaseZone* zone, time_t utc, ZoneOffset& result) const {
+    boost::int64_t when = static_cast<boost::int64_t>(utc);
+    if (!zone || when >= header->coveredUntil) {
+        return false;
+    }
+    
+    // Last transition at or before the time.  The first one starts before any time.
+    const ZoneDatabaseTransition* first = transitions + zone->firstTransition;
+    std::size_t low = 0, high = zone->transitionCount;
+    while (high - low > 1) {
+        std::size_t middle = low + (high - low) / 2;
+        if (first[middle].start <= when) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    
+    result.offset = first[low].offset;
+    result.isDaylight = first[low].isDaylight;
+    result.abbreviation = strings + abbreviations[first[low].abbreviation];
+    return true;
+}
+
+boost::shared_ptr<ZoneDatabase> ZoneDatabase::shared() {
+    boost::mutex::scoped_lock guard(sharedLock);
+    return sharedDatabase;
+}
+
+bool ZoneDatabase::loadShared(const std::string& zoneDirectory) {
+    boost::shared_ptr<ZoneDatabase> database(new ZoneDatabase());
+    std::string path = zoneDirectory;
+    if (!path.empty() && path[path.size() - 1] != '/') {
+        path += '/';
+    }
+    if (!database->open(path + kZoneDatabaseFile)) {
+        database.reset();
+    }
+    
+    boost::mutex::scoped_lock guard(sharedLock);
+    sharedDatabase = database;
+    return (sharedDatabase != 0);
+}
\ No newline at end of file
@@ -0,0 +1,175 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "ZonePreload.he"
+#include "ZoneCache.he"
+#include "ZoneDatabase.he"
+
+#include "SystemDate.h"
+
+#include <boost/algorithm/string.hpp>
+
+#include <cstdlib>
+
+using namespace iCalTools;
+
+// Years preloaded from now when the component connects
+const static int kConnectPreloadYears = 10;
+
+bool iCalTools::getPreloadZones(const std::vector<std::string>& tzids, std::vector<icaltimezone*>& zones, std::string& unknown) {
+    zones.clear();
+    unknown.clear();
+    
+    if (tzids.empty()) {
+        icalarray* builtinZones = icaltimezone_get_builtin_timezones();
+        for (unsigned int x = 0; builtinZones && x < builtinZones->num_elements; ++x) {
+            zones.push_back(static_cast<icaltimezone*>(icalarray_element_at(builtinZones, x)));
+        }
+        return true;
+    }
+    
+    for (std::vector<std::string>::const_iterator it = tzids.begin(); it != tzids.end(); ++it) {
+        icaltimezone* zone = icaltimezone_get_builtin_timezone_from_tzid(it->c_str());
+        if (!zone) {
+            zone = icaltimezone_get_builtin_timezone(it->c_str());
+        }
+        if (zone) {
+            zones.push_back(zone);
+        } else if (unknown.empty()) {
+            unknown = *it;
+        }
+    }
+    return unknown.empty();
+}
+
+void iCalTools::preloadZones(const std::vector<icaltimezone*>& zones, int fromYear, int toYear) {
+    icaltimezone* utcZone = icaltimezone_get_utc_timezone();
+    for (std::vector<icaltimezone*>::const_iterator it = zones.begin(); it != zones.end(); ++it) {
+        icaltimezone* zone = *it;
+        if (!zone || zone == utcZone) {
+            continue;
+        }
+        
+        // Converting a time loads the zone and expands its changes up to the time's year
+        boost::recursive_mutex::scoped_lock libical(ZoneCache::libicalLock());
+        int isDaylight;
+        icaltimetype tt = icaltime_null_time();
+        tt.year = toYear;
+        tt.month = 12;
+        tt.day = 31;
+        icaltimezone_get_utc_offset_of_utc_time(zone, &tt, &isDaylight);
+        
+        tt.year = fromYear;
+        tt.month = 1;
+        tt.day = 1;
+        icaltimezone_get_utc_offset_of_utc_time(zone, &tt, &isDaylight);
+        libical.unlock();
+        
+        // Shared table for conversions
+        ZoneCache::instance().getTable(zone);
+    }
+}
+
+// Preloads a copy of the zones, so the caller's list can go
+class PreloadZones {
+public:
+    PreloadZones(const std::vector<icaltimezone*>& z, int f, int t) : zones(z), fromYear(f), toYear(t) 
+    { }
+    
+    void operator()() {
+        preloadZones(zones, fromYear, toYear);
+    }
+    
+private:
+    std::vector<icaltimezone*> zones;
+    int fromYear;
+    int toYear;
+};
+
+boost::mutex ZoneWarmup::lock;
+boost::shared_ptr<boost::thread> ZoneWarmup::thread;
+
+void ZoneWarmup::start(const std::vector<icaltimezone*>& zones, int fromYear, int toYear) {
+    boost::mutex::scoped_lock guard(lock);
+    if (thread) {
+        thread->join();
+        thread.reset();
+    }
+    
+    try {
+        thread.reset(new boost::thread(PreloadZones(zones, fromYear, toYear)));
+    } catch (boost::thread_resource_error&) {
+        // Out of threads, so preload here
+        preloadZones(zones, fromYear, toYear);
+    }
+}
+
+void ZoneWarmup::wait() {
+    boost::mutex::scoped_lock guard(lock);
+    if (thread) {
+        thread->join();
+        thread.reset();
+    }
+}
+
+void ZoneWarmup::startFromEnvironment() {
+    const char* directory = std::getenv("LIBICAL_ZONE_DIRECTORY");
+    if (!directory || !directory[0]) {
+        return;
+    }
+    set_zone_directory(const_cast<char*>(directory));  // Directory expected as non-const char*
+    ZoneDatabase::loadShared(directory);
+    
+    // Zones to preload (None means all)
+    std::vector<std::string> tzids;
+    const char* preload = std::getenv("LIBICAL_PRELOAD_TIMEZONES");
+    if (!preload) {
+        SystemTimeZone curZone;
+        tzids.push_back(curZone.name());
+    } else {
+        std::string preloadList = boost::trim_copy(std::string(preload));
+        if (preloadList.empty() || boost::iequals(preloadList, "none")) {
+            return;
+        }
+        if (!boost::iequals(preloadList, "all")) {
+            std::vector<std::string> names;
+            boost::split(names, preloadList, boost::is_any_of(","));
+            for (std::vector<std::string>::iterator it = names.begin(); it != names.end(); ++it) {
+                boost::trim(*it);
+                if (!it->empty()) {
+                    tzids.push_back(*it);
+                }
+            }
+            if (tzids.empty()) {
+                return;
+            }
+        }
+    }
+    
+    // Unknown TZIDs are skipped
+    std::vector<icaltimezone*> zones;
+    std::string unknown;
+    getPreloadZones(tzids, zones, unknown);
+    
+    int year = icaltime_today().year;
+    start(zones, year - 1, year + kConnectPreloadYears);
+}
\ No newline at end of file
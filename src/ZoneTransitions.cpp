@@ -0,0 +1,159 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "ZoneTransitions.he"
+#include "ZoneObservances.he"
+#include "RecurrenceIterator.he"
+
+using namespace iCalTools;
+
+// Years that convert to time_t.  Other times are converted by libical.
+const static int kFirstTableYear = 1970;
+const static int kLastTableYear = 2037;
+
+// Tables built from a zone's observances last until the end of kLastTableYear
+const static time_t kCompileUntil = 2145916800;
+
+ZoneTransitions::ZoneTransitions(icaltimezone* z) : zone(z), tableCursor(0), localCursor(0) {
+    isFixed = (!zone || zone == icaltimezone_get_utc_timezone());
+    if (!isFixed) {
+        table = ZoneCache::instance().getTable(zone);
+    }
+}
+
+namespace iCalTools {
+    // For compileObservances.  Tables don't keep abbreviations.
+    static void setAbbreviation(ZoneTransition&, const char*) 
+    { }
+    
+    static bool hasSameAbbreviation(const ZoneTransition&, const ZoneTransition&) {
+        return true;
+    }
+}
+
+boost::shared_ptr<const ZoneTable> ZoneTransitions::compileTable(icaltimezone* zone) {
+    boost::recursive_mutex::scoped_lock libical(ZoneCache::libicalLock());
+    
+    icalcomponent* vtimezone = icaltimezone_get_component(zone);
+    std::vector<ZoneTransition> transitions;
+    if (!vtimezone || !compileObservances(vtimezone, kLastTableYear, transitions)) {
+        return boost::shared_ptr<const ZoneTable>();
+    }
+    return boost::shared_ptr<const ZoneTable>(new ZoneTable(transitions.front().start, kCompileUntil, transitions));
+}
+
+int ZoneTransitions::getOffset(time_t utc, int& isDaylight) {
+    if (table && table->covers(utc)) {
+        tableCursor = table->find(utc, tableCursor);
+        isDaylight = (*table)[tableCursor].isDaylight;
+        return (*table)[tableCursor].offset;
+    }
+    
+    // Past the table, or a zone without observances
+    boost::recursive_mutex::scoped_lock libical(ZoneCache::libicalLock());
+    icaltimetype tt = icaltime_from_timet_with_zone(utc, 0, icaltimezone_get_utc_timezone());
+    isDaylight = 0;
+    return icaltimezone_get_utc_offset_of_utc_time(zone, &tt, &isDaylight);
+}
+
+// Sets the date and time of tt from seconds since the epoch
+static void setTimeFromSeconds(icaltimetype& tt, time_t seconds) {
+    long day = static_cast<long>(seconds / 86400);
+    long secondOfDay = static_cast<long>(seconds % 86400);
+    if (secondOfDay < 0) {
+        secondOfDay += 86400;
+        --day;
+    }
+    getCivilDate(day, tt.year, tt.month, tt.day);
+    tt.hour = static_cast<int>(secondOfDay / 3600);
+    tt.minute = static_cast<int>((secondOfDay / 60) % 60);
+    tt.second = static_cast<int>(secondOfDay % 60);
+}
+
+void ZoneTransitions::convertFromUTC(icaltimetype& tt) {
+    if (isFixed || tt.is_date) {
+        return;
+    }
+    if (tt.year < kFirstTableYear || tt.year > kLastTableYear) {
+        boost::recursive_mutex::scoped_lock libical(ZoneCache::libicalLock());
+        icaltimezone_convert_time(&tt, icaltimezone_get_utc_timezone(), zone);
+        return;
+    }
+    
+    int isDaylight;
+    time_t local = icaltime_as_timet(tt);
+    local += getOffset(local, isDaylight);
+    
+    setTimeFromSeconds(tt, local);
+    tt.is_daylight = isDaylight;
+}
+
+void ZoneTransitions::convertToUTC(icaltimetype& tt) {
+    if (!zone || tt.is_date) {
+        return;
+    }
+    
+    // The table reads skipped and repeated times as libical does, so anything else is left to libical
+    time_t utc;
+    if (isFixed) {
+        // Already UTC
+    } else if (!table || tt.year < kFirstTableYear || tt.year > kLastTableYear 
+               || !table->getUTC(icaltime_as_timet(tt), tt.is_daylight != 0, utc, localCursor)) 
+    {
+        boost::recursive_mutex::scoped_lock libical(ZoneCache::libicalLock());
+        icaltimezone_convert_time(&tt, zone, icaltimezone_get_utc_timezone());
+    } else {
+        setTimeFromSeconds(tt, utc);
+    }
+    
+    // Compared with other UTC times, libical then has no zone to convert it from
+    tt.zone = icaltimezone_get_utc_timezone();
+    tt.is_utc = 1;
+}
+
+time_t ZoneTransitions::asTimet(const icaltimetype& tt) {
+    if (icaltime_is_null_time(tt)) {
+        return 0;
+    }
+    
+    // Dates are midnight in the zone
+    icaltimetype utc = tt;
+    utc.is_date = 0;
+    convertToUTC(utc);
+    return icaltime_as_timet(utc);
+}
+
+icaltimetype ZoneTransitions::fromTimet(time_t utc, int isDate) {
+    // libical only splits up the time for UTC
+    icaltimetype tt = icaltime_from_timet_with_zone(utc, 0, icaltimezone_get_utc_timezone());
+    convertFromUTC(tt);
+    
+    tt.is_date = isDate;
+    if (isDate) {
+        tt.hour = 0;
+        tt.minute = 0;
+        tt.second = 0;
+    }
+    tt.is_utc = (zone == icaltimezone_get_utc_timezone() ? 1 : 0);
+    tt.zone = zone;
+    return tt;
+}
\ No newline at end of file
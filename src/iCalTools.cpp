@@ -27,10 +27,18 @@
 
 // Object type includes
 #include "Recurrence.he"
+#include "ZoneTransitions.he"
+
+#include "SystemDate.h"
 
 // Boost includes
 #include <boost/algorithm/string.hpp>
 
+// memchr and memmove
+#include <cstring>
+#include <cctype>
+#include <vector>
+
 using namespace OmnisTools;
 using namespace LibiCalConstants;
 
@@ -122,6 +130,46 @@ icaltimetype iCalTools::getTimeTypeFromEXTFldVal(tThreadData* pThreadData, EXTfl
     return tt;
 }
 
+// Get an icaltimetype in its zone from an Omnis date or Date object
+bool iCalTools::getZonedTimeTypeFromEXTFldVal(tThreadData* pThreadData, EXTfldval& fVal, icaltimetype& tt) {
+    if ( getType(fVal).valType == fftDate ) {
+        SystemTimeZone curZone;
+        tt = getTimeTypeFromEXTFldVal(pThreadData, fVal);
+        icaltime_set_timezone(&tt, icaltimezone_get_builtin_timezone(curZone.name().c_str()));
+        return !icaltime_is_null_time(tt);
+    }
+    
+    if ( getType(fVal).valType == fftObject || getType(fVal).valType == fftObjref ) {
+        NVObjDate* omnisDateObj = getObjForEXTfldval<NVObjDate>(pThreadData, fVal);
+        if (omnisDateObj) {
+            tt = omnisDateObj->getDateTime();
+            return !icaltime_is_null_time(tt);
+        }
+    }
+    
+    return false;
+}
+
+// Convert a time to another zone through UTC, with the zones' tables of transitions
+icaltimetype iCalTools::convertTimeToZone(const icaltimetype& tt, icaltimezone* zone) {
+    icaltimetype ret = tt;
+    if (tt.is_date || tt.zone == zone) {
+        return ret;
+    }
+    
+    // Floating times keep their time
+    if (tt.zone) {
+        ZoneTransitions fromTransitions(const_cast<icaltimezone*>(tt.zone));
+        fromTransitions.convertToUTC(ret);
+        ZoneTransitions toTransitions(zone);
+        toTransitions.convertFromUTC(ret);
+    }
+    
+    ret.is_utc = (zone == icaltimezone_get_utc_timezone() ? 1 : 0);
+    ret.zone = zone;
+    return ret;
+}
+
 // Get an EXTfldval for an icalrecurrencetype
 void iCalTools::getEXTFldValFromRecurrence(EXTfldval& fVal, icalrecurrencetype rt, OmnisTools::tThreadData* pThreadData) {
     
@@ -2259,3 +2307,178 @@ void iCalTools::getEXTFldValFromiCalChar(EXTfldval& retVal, const char * icsChar
     
     getEXTFldValFromString(retVal, icsString);
 }
+
+
+// Unfold the content line starting at pos in place (RFC5545 3.1) and move pos to the start of the next line.
+// Returns the start of the line; lineEnd is set to the end of the unfolded line.  Follows icalparser_get_line():
+// lines are split on LF, a trailing CR is dropped, and a line starting with a space or tab continues the previous one.
+char* iCalTools::unfoldContentLine(char*& pos, char* end, char*& lineEnd) {
+    char* line = pos;
+    char* readPos = pos;
+    char* writePos = pos;
+    
+    for (;;) {
+        char* newline = static_cast<char*>(memchr(readPos, '\n', end - readPos));
+        char* segmentEnd = (newline ? newline : end);
+        if (newline && newline > readPos && *(newline-1) == '\r') {
+            segmentEnd = newline - 1;
+        }
+        
+        // Shift the segment down over any line breaks removed so far
+        std::size_t segmentLen = segmentEnd - readPos;
+        if (writePos != readPos) {
+            memmove(writePos, readPos, segmentLen);
+        }
+        writePos += segmentLen;
+        
+        if (!newline) {
+            pos = end;
+            break;
+        }
+        
+        // Continuation line: drop the line break and the single leading whitespace character
+        char* next = newline + 1;
+        if (next < end && (*next == ' ' || *next == '\t')) {
+            readPos = next + 1;
+            continue;
+        }
+        
+        pos = next;
+        break;
+    }
+    
+    lineEnd = writePos;
+    return line;
+}
+
+// Case-insensitive check for a prefix (prefix must be upper case)
+static bool startsWithNoCase(const char* str, const char* strEnd, const char* prefix) {
+    for (; *prefix; ++str, ++prefix) {
+        if (str >= strEnd || toupper(static_cast<unsigned char>(*str)) != *prefix)
+            return false;
+    }
+    return true;
+}
+
+// Check if a content line begins or ends a component.  If compName is passed it receives the component name.
+iCalTools::ContentLineMarker iCalTools::getContentLineMarker(const char* line, const char* lineEnd, std::string* compName) {
+    ContentLineMarker marker = MARKER_NONE;
+    const char* name = 0;
+    
+    if (startsWithNoCase(line, lineEnd, "BEGIN:")) {
+        marker = MARKER_BEGIN;
+        name = line + 6;
+    } else if (startsWithNoCase(line, lineEnd, "END:")) {
+        marker = MARKER_END;
+        name = line + 4;
+    }
+    
+    if (compName && name) {
+        const char* nameEnd = lineEnd;
+        while (nameEnd > name && (*(nameEnd-1) == '\r' || *(nameEnd-1) == ' ' || *(nameEnd-1) == '\t'))
+            nameEnd--;
+        compName->assign(name, nameEnd);
+    }
+    
+    return marker;
+}
+
+// Find the first component in a buffer and record where its own content lines and its children are.  Only lines 
+// that start a content line are checked for BEGIN/END (Folded continuation lines start with whitespace).  Nothing 
+// is modified.  Returns false if the component isn't terminated.
+bool iCalTools::scanComponentLayout(char* begin, char* end, ComponentLayout& layout) {
+    layout.rootLines.clear();
+    layout.children.clear();
+    
+    int depth = 0;
+    char* pos = begin;
+    char* segmentStart = begin;
+    char* childStart = begin;
+    
+    while (pos < end) {
+        char* newline = static_cast<char*>(memchr(pos, '\n', end - pos));
+        char* lineEnd = (newline ? newline : end);
+        char* next = (newline ? newline + 1 : end);
+        
+        switch (getContentLineMarker(pos, lineEnd)) {
+            case MARKER_BEGIN:
+                depth++;
+                if (depth == 1) {
+                    segmentStart = pos;
+                } else if (depth == 2) {
+                    layout.rootLines.push_back(ContentRange(segmentStart, pos));
+                    childStart = pos;
+                }
+                break;
+            case MARKER_END:
+                depth--;
+                if (depth == 1) {
+                    layout.children.push_back(ContentRange(childStart, next));
+                    segmentStart = next;
+                } else if (depth == 0) {
+                    layout.rootLines.push_back(ContentRange(segmentStart, next));
+                    return true;
+                } else if (depth < 0) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
+        
+        pos = next;
+    }
+    
+    return false;
+}
+
+// Feed the content lines in a writable buffer to the parser until it completes a component.  On return pos
+// points to the first line that wasn't parsed.  The buffer is modified since lines are unfolded in place.
+icalcomponent* iCalTools::parseContentLines(icalparser* parser, char*& pos, char* end) {
+    icalcomponent* c = 0;
+    char *line, *lineEnd;
+    
+    while (pos < end && !c) {
+        line = unfoldContentLine(pos, end, lineEnd);
+        
+        if (lineEnd < end) {
+            // Terminate over the (now unused) line break
+            *lineEnd = '\0';
+            c = icalparser_add_line(parser, line);
+        } else {
+            // The last line of the buffer has no line break to terminate over, so it has to be copied
+            std::vector<char> lastLine(line, lineEnd);
+            lastLine.push_back('\0');
+            c = icalparser_add_line(parser, &lastLine[0]);
+        }
+    }
+    
+    return c;
+}
+
+// Keep parsing to the end of the buffer.  Like icalparser_parse, a second component moves the first one under an 
+// XROOT, and a component left unfinished at the end is dropped.
+icalcomponent* iCalTools::parseAllContentLines(icalparser* parser, char* pos, char* end) {
+    icalcomponent* root = 0;
+    icalcomponent* c;
+    
+    while (pos < end) {
+        c = parseContentLines(parser, pos, end);
+        if (!c) {
+            break;
+        }
+        
+        if (!root) {
+            root = c;
+        } else if (icalcomponent_isa(root) != ICAL_XROOT_COMPONENT) {
+            icalcomponent* xroot = icalcomponent_new(ICAL_XROOT_COMPONENT);
+            icalcomponent_add_component(xroot, root);
+            icalcomponent_add_component(xroot, c);
+            root = xroot;
+        } else {
+            icalcomponent_add_component(root, c);
+        }
+    }
+    
+    return root;
+}
\ No newline at end of file
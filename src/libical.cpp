@@ -28,6 +28,7 @@
 #include "Parameter.he"
 #include "Property.he"
 #include "Value.he"
+#include "ComponentReader.he"
 // Complex Types
 #include "Attach.he"
 #include "Date.he"
@@ -36,11 +37,14 @@
 #include "Geo.he"
 #include "Period.he"
 #include "Recurrence.he"
+#include "RecurrenceIteratorObj.he"
 #include "TimeSpan.he"
 #include "TimeZone.he"
 #include "TimeZonePhase.he"
 #include "Trigger.he"
 
+#include "ZonePreload.he"
+
 using OmnisTools::tThreadData;
 
 // Resource # of library name
@@ -55,27 +59,30 @@ const static qshort cNVObjGroupCore  = 1001,
                     cNVObjGroupTypes = 1010;
 
 // Resource # for objects.  In this project it is also the Unique ID; when an object is called mCompId will equal this.
-const qshort cNVObjComponent      = 1002,
-             cNVObjProperty       = 1003,
-             cNVObjParameter      = 1004,
-             cNVObjValue          = 1005,
-             cNVObjDate           = 1011,
-             cNVObjDuration       = 1012,
-             cNVObjTrigger        = 1013,
-             cNVObjRecurrence     = 1014,
-             cNVObjPeriod         = 1015,
-             cNVObjDateTimePeriod = 1016,
-             cNVObjAttach         = 1017,
-             cNVObjGeo            = 1018,
-             cNVObjTimeZonePhase  = 1019,
-             cNVObjTimeZone       = 1020,
-             cNVObjTimeSpan       = 1021;
+const qshort cNVObjComponent       = 1002,
+             cNVObjProperty        = 1003,
+             cNVObjParameter       = 1004,
+             cNVObjValue           = 1005,
+             cNVObjComponentReader = 1006,
+             cNVObjDate            = 1011,
+             cNVObjDuration        = 1012,
+             cNVObjTrigger         = 1013,
+             cNVObjRecurrence      = 1014,
+             cNVObjPeriod          = 1015,
+             cNVObjDateTimePeriod  = 1016,
+             cNVObjAttach          = 1017,
+             cNVObjGeo             = 1018,
+             cNVObjTimeZonePhase   = 1019,
+             cNVObjTimeZone        = 1020,
+             cNVObjTimeSpan        = 1021,
+             cNVObjRecurrenceIterator = 1022;
 
 // Set static id's for matching classes (This is used for creating new objects without needing to know the Omnis ID. See: OmnisTools::createNVObj() )
 qshort NVObjComponent::objResourceId = cNVObjComponent;
 qshort NVObjProperty::objResourceId  = cNVObjProperty;
 qshort NVObjParameter::objResourceId = cNVObjParameter;
 qshort NVObjValue::objResourceId     = cNVObjValue;
+qshort NVObjComponentReader::objResourceId = cNVObjComponentReader;
 
 qshort NVObjDate::objResourceId           = cNVObjDate;
 qshort NVObjDuration::objResourceId       = cNVObjDuration;
@@ -88,6 +95,7 @@ qshort NVObjGeo::objResourceId            = cNVObjGeo;
 qshort NVObjTimeZonePhase::objResourceId  = cNVObjTimeZonePhase;
 qshort NVObjTimeZone::objResourceId       = cNVObjTimeZone;
 qshort NVObjTimeSpan::objResourceId       = cNVObjTimeSpan;
+qshort NVObjRecurrenceIterator::objResourceId = cNVObjRecurrenceIterator;
 
 // Omnis objects contained within this component.
 // Columns are:
@@ -102,6 +110,7 @@ ECOobject objectsTable[] =
     cNVObjProperty,  cNVObjProperty,  0, cNVObjGroupCore,
     cNVObjParameter, cNVObjParameter, 0, cNVObjGroupCore,
     cNVObjValue,     cNVObjValue,     0, cNVObjGroupCore,
+    cNVObjComponentReader, cNVObjComponentReader, 0, cNVObjGroupCore,
     // Types
     cNVObjDate,           cNVObjDate,           0, cNVObjGroupTypes,
     cNVObjDuration,       cNVObjDuration,       0, cNVObjGroupTypes,
@@ -114,6 +123,7 @@ ECOobject objectsTable[] =
     cNVObjTimeZonePhase,  cNVObjTimeZonePhase,  0, cNVObjGroupTypes,
     cNVObjTimeZone,       cNVObjTimeZone,       0, cNVObjGroupTypes,
     cNVObjTimeSpan,       cNVObjTimeSpan,       0, cNVObjGroupTypes,
+    cNVObjRecurrenceIterator, cNVObjRecurrenceIterator, 0, cNVObjGroupTypes,
     
 };
 
@@ -140,6 +150,8 @@ NVObjBase* createObject( qlong propID, qobjinst objinst, tThreadData *pThreadDat
 			return new NVObjParameter(objinst, pThreadData);
         case cNVObjValue:
 			return new NVObjValue(objinst, pThreadData);
+        case cNVObjComponentReader:
+			return new NVObjComponentReader(objinst, pThreadData);
         // Types
         case cNVObjAttach:
             return new NVObjAttach(objinst, pThreadData);
@@ -155,6 +167,8 @@ NVObjBase* createObject( qlong propID, qobjinst objinst, tThreadData *pThreadDat
             return new NVObjPeriod(objinst, pThreadData);
         case cNVObjRecurrence:
             return new NVObjRecurrence(objinst, pThreadData);
+        case cNVObjRecurrenceIterator:
+            return new NVObjRecurrenceIterator(objinst, pThreadData);
         case cNVObjTimeSpan:
             return new NVObjTimeSpan(objinst, pThreadData);
         case cNVObjTimeZone:
@@ -186,6 +200,9 @@ void copyObject( qlong propID, objCopyInfo* copyInfo, tThreadData *pThreadData )
         case cNVObjValue:
             copyNVObj<NVObjValue>(propID, copyInfo, pThreadData);
             break;
+        case cNVObjComponentReader:
+            copyNVObj<NVObjComponentReader>(propID, copyInfo, pThreadData);
+            break;
         // Types
         case cNVObjAttach:
             copyNVObj<NVObjAttach>(propID, copyInfo, pThreadData);
@@ -208,6 +225,9 @@ void copyObject( qlong propID, objCopyInfo* copyInfo, tThreadData *pThreadData )
         case cNVObjRecurrence:
             copyNVObj<NVObjRecurrence>(propID, copyInfo, pThreadData);
             break;
+        case cNVObjRecurrenceIterator:
+            copyNVObj<NVObjRecurrenceIterator>(propID, copyInfo, pThreadData);
+            break;
         case cNVObjTimeSpan:
             copyNVObj<NVObjTimeSpan>(propID, copyInfo, pThreadData);
             break;
@@ -241,6 +261,9 @@ void removeObject( qlong propID, NVObjBase* nvObj ) {
         case cNVObjValue:
 			delete (NVObjValue*)nvObj;
 			break;
+        case cNVObjComponentReader:
+			delete (NVObjComponentReader*)nvObj;
+			break;
         // Types
         case cNVObjAttach:
             delete (NVObjAttach*)nvObj;
@@ -263,6 +286,9 @@ void removeObject( qlong propID, NVObjBase* nvObj ) {
         case cNVObjRecurrence:
             delete (NVObjRecurrence*)nvObj;
             break;
+        case cNVObjRecurrenceIterator:
+            delete (NVObjRecurrenceIterator*)nvObj;
+            break;
         case cNVObjTimeSpan:
             delete (NVObjTimeSpan*)nvObj;
             break;
@@ -350,6 +376,9 @@ extern "C" qlong OMNISWNDPROC NVObjWndProc(HWND hwnd, LPARAM Msg, WPARAM wParam,
 		// For most components this can be removed - see other BLYTH component examples
 		case ECM_CONNECT:
 		{
+			// Preload time zones in the background, if configured
+			iCalTools::ZoneWarmup::startFromEnvironment();
+			
 			return EXT_FLAG_LOADED|EXT_FLAG_NVOBJECTS|EXT_FLAG_REMAINLOADED|EXT_FLAG_ALWAYS_USABLE; // Return external flags. Loaded & Has Non-Visual Objects
 		} 
 			
@@ -360,6 +389,7 @@ extern "C" qlong OMNISWNDPROC NVObjWndProc(HWND hwnd, LPARAM Msg, WPARAM wParam,
 		// For most components this can be removed - see other BLYTH component examples
 		case ECM_DISCONNECT:
 		{ 
+			iCalTools::ZoneWarmup::wait();
 			return qtrue;
 		}
 			
@@ -398,6 +428,7 @@ extern "C" qlong OMNISWNDPROC NVObjWndProc(HWND hwnd, LPARAM Msg, WPARAM wParam,
 		case ECM_METHODCALL:
 		{
 			tThreadData threadData(eci);
+			iCalTools::ZoneWarmup::wait();  // Zones can't be used while they're being preloaded
 			
 			void* obj = ECOfindNVObject( eci->mOmnisInstance, lParam );
 			if ( NULL != obj )
@@ -450,6 +481,7 @@ extern "C" qlong OMNISWNDPROC NVObjWndProc(HWND hwnd, LPARAM Msg, WPARAM wParam,
 		case ECM_GETPROPERTY:
 		{
 			tThreadData threadData(eci);
+			iCalTools::ZoneWarmup::wait();
 			
 			// Get the instance of the object
 			NVObjBase* nvObj = reinterpret_cast<NVObjBase*>(ECOfindNVObject(eci->mOmnisInstance, lParam));
@@ -465,6 +497,7 @@ extern "C" qlong OMNISWNDPROC NVObjWndProc(HWND hwnd, LPARAM Msg, WPARAM wParam,
 		case ECM_SETPROPERTY:
 		{			
 			tThreadData threadData(eci);
+			iCalTools::ZoneWarmup::wait();
 			
 			NVObjBase* nvObj = reinterpret_cast<NVObjBase*>(ECOfindNVObject(eci->mOmnisInstance, lParam));
 			if( NULL != nvObj )
@@ -0,0 +1,246 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2014 Arts Management Systems Ltd.
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Compiles the VTIMEZONE files of a zone directory (resource/zoneinfo) into zones.bin, the table of UTC transitions 
+// that ZoneDatabase maps at runtime.  Run it on each platform the component is built for, since the table is written 
+// in the machine's byte order.  See Compiling.txt.
+//
+//     ZoneCompiler <zone directory> [output file = <zone directory>/zones.bin]
+
+#include <libical/ical.h>
+
+#include "ZoneDatabase.he"
+#include "ZoneObservances.he"
+#include "RecurrenceIterator.he"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace iCalTools;
+
+// Rules are expanded up to the end of this year.  Later times are converted by libical.
+const static int kLastYear = 2100;
+
+struct CompiledTransition {
+    boost::int64_t start;
+    boost::int32_t offset;
+    bool isDaylight;
+    std::string abbreviation;
+};
+
+// For compileObservances
+static void setAbbreviation(CompiledTransition& transition, const char* abbreviation) {
+    transition.abbreviation = abbreviation;
+}
+
+static bool hasSameAbbreviation(const CompiledTransition& a, const CompiledTransition& b) {
+    return a.abbreviation == b.abbreviation;
+}
+
+struct CompiledZone {
+    std::string location;
+    std::vector<CompiledTransition> transitions;
+    
+    bool operator<(const CompiledZone& other) const { return location < other.location; }
+};
+
+// Strings and abbreviations are stored once, however many zones use them
+class StringTable {
+public:
+    boost::uint32_t add(const std::string& value) {
+        std::map<std::string, boost::uint32_t>::iterator it = offsets.find(value);
+        if (it != offsets.end()) {
+            return it->second;
+        }
+        boost::uint32_t offset = static_cast<boost::uint32_t>(data.size());
+        data.insert(data.end(), value.begin(), value.end());
+        data.push_back('\0');
+        offsets[value] = offset;
+        return offset;
+    }
+    
+    boost::uint16_t addAbbreviation(const std::string& value) {
+        std::map<std::string, boost::uint16_t>::iterator it = abbreviationIndexes.find(value);
+        if (it != abbreviationIndexes.end()) {
+            return it->second;
+        }
+        boost::uint16_t index = static_cast<boost::uint16_t>(abbreviations.size());
+        abbreviations.push_back(add(value));
+        abbreviationIndexes[value] = index;
+        return index;
+    }
+    
+    std::vector<char> data;
+    std::vector<boost::uint32_t> abbreviations;
+    
+private:
+    std::map<std::string, boost::uint32_t> offsets;
+    std::map<std::string, boost::uint16_t> abbreviationIndexes;
+};
+
+static bool readFile(const std::string& path, std::string& contents) {
+    std::ifstream input(path.c_str(), std::ios::in | std::ios::binary);
+    if (!input) {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << input.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+// Reads the zones listed in zones.tab ("latitude longitude location" per line)
+static bool readZones(const std::string& zoneDirectory, std::vector<CompiledZone>& zones) {
+    std::string zonesTab;
+    if (!readFile(zoneDirectory + "/zones.tab", zonesTab)) {
+        std::fprintf(stderr, "Unable to read %s/zones.tab\n", zoneDirectory.c_str());
+        return false;
+    }
+    
+    std::istringstream lines(zonesTab);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        std::string latitude, longitude;
+        CompiledZone zone;
+        if (!(fields >> latitude >> longitude >> zone.location)) {
+            continue;
+        }
+        
+        std::string contents;
+        std::string path = zoneDirectory + "/" + zone.location + ".ics";
+        if (!readFile(path, contents)) {
+            std::fprintf(stderr, "Unable to read %s\n", path.c_str());
+            return false;
+        }
+        
+        icalcomponent* calendar = icalparser_parse_string(contents.c_str());
+        icalcomponent* vtimezone = 0;
+        if (calendar) {
+            vtimezone = (icalcomponent_isa(calendar) == ICAL_VTIMEZONE_COMPONENT ? calendar 
+                         : icalcomponent_get_first_component(calendar, ICAL_VTIMEZONE_COMPONENT));
+        }
+        bool compiled = (vtimezone && compileObservances(vtimezone, kLastYear, zone.transitions));
+        if (calendar) {
+            icalcomponent_free(calendar);
+        }
+        if (!compiled) {
+            std::fprintf(stderr, "Unable to compile %s\n", path.c_str());
+            return false;
+        }
+        zones.push_back(zone);
+    }
+    
+    // Bisected by location at runtime
+    std::sort(zones.begin(), zones.end());
+    return true;
+}
+
+template<class T>
+static void writeRecords(std::ofstream& output, const std::vector<T>& records) {
+    if (!records.empty()) {
+        output.write(reinterpret_cast<const char*>(&records[0]), static_cast<std::streamsize>(records.size() * sizeof(T)));
+    }
+}
+
+static bool writeDatabase(const std::vector<CompiledZone>& zones, const std::string& outputPath) {
+    StringTable strings;
+    std::vector<ZoneDatabaseTransition> transitions;
+    std::vector<ZoneDatabaseZone> zoneRecords;
+    
+    for (std::size_t x = 0; x < zones.size(); ++x) {
+        ZoneDatabaseZone record;
+        std::memset(&record, 0, sizeof(record));
+        record.location = strings.add(zones[x].location);
+        record.firstTransition = static_cast<boost::uint32_t>(transitions.size());
+        record.transitionCount = static_cast<boost::uint32_t>(zones[x].transitions.size());
+        zoneRecords.push_back(record);
+        
+        for (std::size_t y = 0; y < zones[x].transitions.size(); ++y) {
+            const CompiledTransition& compiled = zones[x].transitions[y];
+            ZoneDatabaseTransition transition;
+            std::memset(&transition, 0, sizeof(transition));
+            transition.start = compiled.start;
+            transition.offset = compiled.offset;
+            transition.isDaylight = (compiled.isDaylight ? 1 : 0);
+            transition.abbreviation = strings.addAbbreviation(compiled.abbreviation);
+            transitions.push_back(transition);
+        }
+    }
+    
+    ZoneDatabaseHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kZoneDatabaseMagic, sizeof(kZoneDatabaseMagic));
+    header.byteOrder = kZoneDatabaseByteOrder;
+    header.version = kZoneDatabaseVersion;
+    header.coveredUntil = static_cast<boost::int64_t>(getDayNumber(kLastYear + 1, 1, 1)) * 86400;
+    header.transitionCount = static_cast<boost::uint32_t>(transitions.size());
+    header.transitionsOffset = static_cast<boost::uint32_t>(sizeof(header));
+    header.zoneCount = static_cast<boost::uint32_t>(zoneRecords.size());
+    header.zonesOffset = header.transitionsOffset + header.transitionCount * sizeof(ZoneDatabaseTransition);
+    header.abbreviationCount = static_cast<boost::uint32_t>(strings.abbreviations.size());
+    header.abbreviationsOffset = header.zonesOffset + header.zoneCount * sizeof(ZoneDatabaseZone);
+    header.stringsSize = static_cast<boost::uint32_t>(strings.data.size());
+    header.stringsOffset = header.abbreviationsOffset + header.abbreviationCount * sizeof(boost::uint32_t);
+    
+    std::ofstream output(outputPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!output) {
+        std::fprintf(stderr, "Unable to write %s\n", outputPath.c_str());
+        return false;
+    }
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeRecords(output, transitions);
+    writeRecords(output, zoneRecords);
+    writeRecords(output, strings.abbreviations);
+    writeRecords(output, strings.data);
+    output.close();
+    if (!output) {
+        std::fprintf(stderr, "Unable to write %s\n", outputPath.c_str());
+        return false;
+    }
+    
+    std::printf("%s: %lu zones, %lu transitions\n", outputPath.c_str(), 
+                static_cast<unsigned long>(zoneRecords.size()), static_cast<unsigned long>(transitions.size()));
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::fprintf(stderr, "Usage: %s <zone directory> [output file]\n", argv[0]);
+        return 2;
+    }
+    
+    std::string zoneDirectory = argv[1];
+    std::string outputPath = (argc == 3 ? std::string(argv[2]) : zoneDirectory + "/zones.bin");
+    
+    std::vector<CompiledZone> zones;
+    if (!readZones(zoneDirectory, zones) || !writeDatabase(zones, outputPath)) {
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file